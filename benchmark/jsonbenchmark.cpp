@@ -0,0 +1,299 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Measures parse and serialize throughput of QtJson on a generated corpus and
+ * verifies that all parser modes agree with each other.
+ *
+ * usage: jsonbenchmark [minimum time per measurement in ms] [document filter]
+ */
+
+#include "json.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <cstdlib>
+#include <cstdio>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+
+#if defined(__GLIBC__)
+
+// count every heap allocation in the process, including those made inside Qt
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static std::atomic<unsigned long long> s_Allocations(0);
+
+extern "C" void *malloc(size_t size)
+{
+  ++s_Allocations;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  ++s_Allocations;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  ++s_Allocations;
+  return __libc_realloc(ptr, size);
+}
+
+static bool allocationsCounted() { return true; }
+static unsigned long long allocationCount() { return s_Allocations.load(); }
+
+#else // __GLIBC__
+
+static bool allocationsCounted() { return false; }
+static unsigned long long allocationCount() { return 0ULL; }
+
+#endif // __GLIBC__
+
+
+namespace {
+
+struct Document {
+  QString name;
+  QByteArray data;
+  bool isArray;
+};
+
+
+QByteArray fileRecord(int index)
+{
+  QByteArray number = QByteArray::number(index);
+  return "{\"id\":" + number
+       + ",\"name\":\"Texture Pack " + number + "\""
+       + ",\"uri\":\"Texture Pack " + number + "-1234-1-" + number + ".7z\""
+       + ",\"version\":\"1." + number + "\""
+       + ",\"description\":\"High resolution textures for the landscape, part " + number + "\""
+       + ",\"category_id\":" + QByteArray::number(index % 4)
+       + ",\"size\":" + QByteArray::number(index * 1021 + 4096)
+       + ",\"ratio\":1.5"
+       + ",\"primary\":" + ((index % 2) == 0 ? "true" : "false")
+       + ",\"requirements\":null"
+       + ",\"tags\":[\"textures\",\"landscape\"]}";
+}
+
+QByteArray recordArray(int count)
+{
+  QByteArray result = "[";
+  for (int i = 0; i < count; ++i) {
+    if (i != 0) {
+      result += ",\n";
+    }
+    result += fileRecord(i);
+  }
+  result += "]";
+  return result;
+}
+
+QByteArray nestedDocument(int depth)
+{
+  QByteArray result;
+  for (int i = 0; i < depth; ++i) {
+    result += (i % 2) == 0 ? "{\"level\":" + QByteArray::number(i) + ",\"child\":" : QByteArray("[");
+  }
+  result += "null";
+  for (int i = depth - 1; i >= 0; --i) {
+    result += (i % 2) == 0 ? "}" : "]";
+  }
+  return result;
+}
+
+QByteArray escapeDocument(int count)
+{
+  QByteArray result = "[";
+  for (int i = 0; i < count; ++i) {
+    if (i != 0) {
+      result += ",";
+    }
+    result += "\"C:\\\\Games\\\\Skyrim\\\\Data\\\\textures\\\\file" + QByteArray::number(i)
+            + ".dds\\n\\t\\\"quoted\\\" caf\\u00e9 \\/ \\r\\n\"";
+  }
+  result += "]";
+  return result;
+}
+
+QByteArray unicodeDocument(int count)
+{
+  QByteArray result = "[";
+  for (int i = 0; i < count; ++i) {
+    if (i != 0) {
+      result += ",";
+    }
+    result += "{\"name\":\"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88 "
+            + QByteArray::number(i)
+            + "\",\"author\":\"\xd0\x90\xd0\xb2\xd1\x82\xd0\xbe\xd1\x80 \xc3\x9cml\xc3\xa4ut\""
+            + ",\"note\":\"\xf0\x9f\x98\x80\xf0\x9f\x8e\xae \xf0\x9f\x91\x8d\"}";
+  }
+  result += "]";
+  return result;
+}
+
+std::vector<Document> createCorpus()
+{
+  std::vector<Document> corpus;
+  corpus.push_back({ "small", fileRecord(1), false });
+  corpus.push_back({ "medium", recordArray(500), true });
+  corpus.push_back({ "large", recordArray(30000), true });
+  corpus.push_back({ "nested", nestedDocument(500), false });
+  corpus.push_back({ "escapes", escapeDocument(5000), true });
+  corpus.push_back({ "unicode", unicodeDocument(5000), true });
+  return corpus;
+}
+
+
+struct Measurement {
+  double megabytesPerSecond;
+  double allocationsPerRun;
+};
+
+/**
+ * run the operation until at least minimumTime has passed
+ * @param bytes number of bytes processed per run
+ */
+Measurement measure(const std::function<void()> &operation, qint64 bytes, qint64 minimumTime)
+{
+  // warm up, this also makes sure caches are initialized before counting
+  operation();
+
+  QElapsedTimer timer;
+  unsigned long long allocationsBefore = allocationCount();
+  int runs = 0;
+  timer.start();
+  do {
+    operation();
+    ++runs;
+  } while (timer.elapsed() < minimumTime);
+  qint64 elapsed = timer.nsecsElapsed();
+  unsigned long long allocations = allocationCount() - allocationsBefore;
+
+  Measurement result;
+  result.megabytesPerSecond = (static_cast<double>(bytes) * runs / (1024.0 * 1024.0))
+                              / (static_cast<double>(elapsed) / 1000000000.0);
+  result.allocationsPerRun = static_cast<double>(allocations) / runs;
+  return result;
+}
+
+void report(const Document &document, const char *operation, const Measurement &measurement, bool correct)
+{
+  if (allocationsCounted()) {
+    printf("%-10s %10d  %-18s %10.1f %14.0f  %s\n",
+           qPrintable(document.name), document.data.size(), operation,
+           measurement.megabytesPerSecond, measurement.allocationsPerRun,
+           correct ? "ok" : "MISMATCH");
+  } else {
+    printf("%-10s %10d  %-18s %10.1f %14s  %s\n",
+           qPrintable(document.name), document.data.size(), operation,
+           measurement.megabytesPerSecond, "n/a",
+           correct ? "ok" : "MISMATCH");
+  }
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+  qint64 minimumTime = argc > 1 ? atoi(argv[1]) : 500;
+  QString filter = argc > 2 ? QString::fromLocal8Bit(argv[2]) : QString();
+
+  printf("%-10s %10s  %-18s %10s %14s  %s\n",
+         "document", "bytes", "operation", "MB/s", "allocs/run", "check");
+
+  bool allCorrect = true;
+
+  for (const Document &document : createCorpus()) {
+    if (!filter.isEmpty() && (document.name != filter)) {
+      continue;
+    }
+
+    QString text = QString::fromUtf8(document.data);
+    bool success = true;
+    const QVariant reference = QtJson::parse(text, success);
+    if (!success) {
+      printf("%s: reference parse failed\n", qPrintable(document.name));
+      allCorrect = false;
+      continue;
+    }
+
+    {
+      Measurement measurement = measure([&] () { QtJson::parse(text); }, document.data.size(), minimumTime);
+      report(document, "parse", measurement, true);
+    }
+
+    {
+      QtJson::LazyDocument lazy;
+      Measurement measurement = measure([&] () { lazy.parse(document.data); }, document.data.size(), minimumTime);
+      report(document, "lazy index", measurement, lazy.isValid());
+      allCorrect = allCorrect && lazy.isValid();
+    }
+
+    {
+      QVariant result;
+      Measurement measurement = measure([&] () {
+        QtJson::LazyDocument lazy(document.data);
+        result = lazy.root().toVariant();
+      }, document.data.size(), minimumTime);
+      bool correct = result == reference;
+      report(document, "lazy materialize", measurement, correct);
+      allCorrect = allCorrect && correct;
+    }
+
+    if (document.isArray) {
+      QVariantList result;
+      Measurement measurement = measure([&] () {
+        bool bulkSuccess = true;
+        result = QtJson::parseBulk(document.data, bulkSuccess);
+      }, document.data.size(), minimumTime);
+      bool correct = result == reference.toList();
+      report(document, "bulk", measurement, correct);
+      allCorrect = allCorrect && correct;
+    }
+
+    for (int style = QtJson::StyleReadable; style <= QtJson::StyleCompact; ++style) {
+      QtJson::SerializeStyle serializeStyle = static_cast<QtJson::SerializeStyle>(style);
+      bool serializeSuccess = true;
+      // throughput is relative to the generated text
+      const QByteArray output = QtJson::serialize(reference, serializeSuccess, serializeStyle);
+      Measurement measurement = measure([&] () {
+        QtJson::serialize(reference, serializeSuccess, serializeStyle);
+      }, output.size(), minimumTime);
+      bool roundTrip = true;
+      bool correct = serializeSuccess
+                  && (QtJson::parse(QString::fromUtf8(output), roundTrip) == reference)
+                  && roundTrip;
+      report(document, style == QtJson::StyleReadable ? "serialize" : "serialize compact",
+             measurement, correct);
+      allCorrect = allCorrect && correct;
+    }
+  }
+
+  return allCorrect ? 0 : 1;
+}
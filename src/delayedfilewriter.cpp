@@ -1,57 +1,458 @@
 #include "delayedfilewriter.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include "utility.h"
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#endif
 
 
 using namespace MOBase;
 
 
-DelayedFileWriterBase::DelayedFileWriterBase(int delay)
+namespace {
+
+struct WriteItem {
+  QString fileName;
+  QByteArray data;
+};
+
+std::atomic<quint32> s_TemporaryCounter(0);
+
+/**
+ * name of a file next to the target that neither exists yet nor is used by another
+ * write of this or another process
+ */
+QString temporaryName(const QString &fileName)
+{
+#ifdef Q_OS_WIN
+  qint64 pid = ::_getpid();
+#else
+  qint64 pid = ::getpid();
+#endif
+  for (;;) {
+    QString result = QString("%1.%2.%3.tmp").arg(fileName).arg(pid).arg(s_TemporaryCounter++);
+    if (!QFile::exists(result)) {
+      return result;
+    }
+  }
+}
+
+/**
+ * makes the rename of a file in the directory durable
+ */
+void syncDirectory(const QString &fileName)
+{
+#ifdef Q_OS_WIN
+  // MOVEFILE_WRITE_THROUGH covers this
+  Q_UNUSED(fileName);
+#else
+  QByteArray directory = QFile::encodeName(QFileInfo(fileName).absolutePath());
+  int fd = ::open(directory.constData(), O_RDONLY | O_DIRECTORY);
+  if ((fd == -1) || (::fsync(fd) != 0)) {
+    qWarning("failed to flush directory of \"%s\" to disk: %s", qPrintable(fileName), strerror(errno));
+  }
+  if (fd != -1) {
+    ::close(fd);
+  }
+#endif
+}
+
+bool syncFile(QFile &file)
+{
+  if (!file.flush()) {
+    return false;
+  }
+#ifdef Q_OS_WIN
+  return ::FlushFileBuffers(reinterpret_cast<HANDLE>(::_get_osfhandle(file.handle()))) != 0;
+#else
+  return ::fsync(file.handle()) == 0;
+#endif
+}
+
+bool replaceFile(const QString &temporary, const QString &target, bool sync, QString *errorMessage)
+{
+#ifdef Q_OS_WIN
+  DWORD flags = MOVEFILE_REPLACE_EXISTING | (sync ? MOVEFILE_WRITE_THROUGH : 0);
+  if (!::MoveFileExW(ToWString(QDir::toNativeSeparators(temporary)).c_str(),
+                     ToWString(QDir::toNativeSeparators(target)).c_str(), flags)) {
+    if (errorMessage != nullptr) {
+      *errorMessage = windowsErrorString(::GetLastError());
+    }
+    QFile::remove(temporary);
+    return false;
+  }
+#else
+  if (::rename(QFile::encodeName(temporary).constData(), QFile::encodeName(target).constData()) != 0) {
+    if (errorMessage != nullptr) {
+      *errorMessage = QString::fromLocal8Bit(strerror(errno));
+    }
+    QFile::remove(temporary);
+    return false;
+  }
+  if (sync) {
+    // otherwise the rename itself may be lost in a crash
+    syncDirectory(target);
+  }
+#endif
+  return true;
+}
+
+bool writeTemporary(QFile &file, const QByteArray &data, QString *errorMessage)
+{
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+      || (file.write(data) != data.size())) {
+    if (errorMessage != nullptr) {
+      *errorMessage = file.errorString();
+    }
+    file.close();
+    file.remove();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * writes the files that were due at the same time
+ */
+class WriteBatch : public QRunnable {
+public:
+  WriteBatch(std::vector<WriteItem> &&items, WriteBehindScheduler::SyncMode syncMode)
+    : m_Items(std::move(items)), m_SyncMode(syncMode)
+  {}
+
+  virtual void run() override
+  {
+    if (m_SyncMode != WriteBehindScheduler::SYNC_BATCH) {
+      for (const WriteItem &item : m_Items) {
+        QString errorMessage;
+        if (!WriteBehindScheduler::writeFileAtomic(item.fileName, item.data,
+                                                   m_SyncMode == WriteBehindScheduler::SYNC_EACH,
+                                                   &errorMessage)) {
+          qCritical("failed to write \"%s\": %s", qPrintable(item.fileName), qPrintable(errorMessage));
+        }
+      }
+      return;
+    }
+
+    // write all files first and flush them afterwards so the file system gets to
+    // combine the flushes, then replace the targets
+    std::vector<std::unique_ptr<QFile>> files;
+    for (const WriteItem &item : m_Items) {
+      std::unique_ptr<QFile> file(new QFile(temporaryName(item.fileName)));
+      QString errorMessage;
+      if (!writeTemporary(*file, item.data, &errorMessage)) {
+        qCritical("failed to write \"%s\": %s", qPrintable(item.fileName), qPrintable(errorMessage));
+        file.reset();
+      }
+      files.push_back(std::move(file));
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+      if ((files[i] != nullptr) && !syncFile(*files[i])) {
+        qWarning("failed to flush \"%s\" to disk", qPrintable(m_Items[i].fileName));
+      }
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (files[i] == nullptr) {
+        continue;
+      }
+      files[i]->close();
+      QString errorMessage;
+      if (!replaceFile(files[i]->fileName(), m_Items[i].fileName, true, &errorMessage)) {
+        qCritical("failed to replace \"%s\": %s", qPrintable(m_Items[i].fileName), qPrintable(errorMessage));
+      }
+    }
+  }
+
+private:
+  std::vector<WriteItem> m_Items;
+  WriteBehindScheduler::SyncMode m_SyncMode;
+};
+
+}
+
+
+DelayedFileWriterBase::DelayedFileWriterBase(int delay, int maxLatency)
   : m_TimerDelay(delay)
-  , m_Timer()
+  , m_MaxLatency(maxLatency)
 {
-  QObject::connect(&m_Timer, &QTimer::timeout, this, &DelayedFileWriter::timerExpired);
-  m_Timer.setSingleShot(true);
 }
 
 DelayedFileWriterBase::~DelayedFileWriterBase()
 {
-  if (m_Timer.isActive()) {
+  WriteBehindScheduler &scheduler = WriteBehindScheduler::instance();
+  if (scheduler.isScheduled(this)) {
     qCritical("delayed file save timer active at shutdown");
+    scheduler.cancel(this);
   }
 }
 
 void DelayedFileWriterBase::write()
 {
-  m_Timer.start(m_TimerDelay);
+  WriteBehindScheduler::instance().schedule(this);
 }
 
 void DelayedFileWriterBase::cancel()
 {
-  m_Timer.stop();
+  WriteBehindScheduler::instance().cancel(this);
 }
 
 void DelayedFileWriterBase::writeImmediately(bool ifOnTimer)
 {
-  if (!ifOnTimer || m_Timer.isActive()) {
+  WriteBehindScheduler &scheduler = WriteBehindScheduler::instance();
+  if (!ifOnTimer || scheduler.isScheduled(this)) {
+    scheduler.cancel(this);
+    // older data still on its way to disk must not overwrite what is written now
+    scheduler.waitForWrites();
     doWrite();
-    m_Timer.stop();
   }
 }
 
-void DelayedFileWriterBase::timerExpired()
+bool DelayedFileWriterBase::snapshot(QString&, QByteArray&)
 {
-  doWrite();
+  return false;
+}
+
+void DelayedFileWriterBase::doWrite()
+{
+  QString fileName;
+  QByteArray data;
+  if (snapshot(fileName, data)) {
+    QString errorMessage;
+    if (!WriteBehindScheduler::writeFileAtomic(fileName, data, true, &errorMessage)) {
+      qCritical("failed to write \"%s\": %s", qPrintable(fileName), qPrintable(errorMessage));
+    }
+  }
 }
 
 
 
 DelayedFileWriter::DelayedFileWriter(DelayedFileWriter::WriterFunc func
-                                     , int delay)
-  : DelayedFileWriterBase(delay)
+                                     , int delay, int maxLatency)
+  : DelayedFileWriterBase(delay, maxLatency)
   , m_Func(func)
 {
 }
 
+DelayedFileWriter::DelayedFileWriter(const QString &fileName, SnapshotFunc func
+                                     , int delay, int maxLatency)
+  : DelayedFileWriterBase(delay, maxLatency)
+  , m_FileName(fileName)
+  , m_SnapshotFunc(func)
+{
+}
+
+bool DelayedFileWriter::snapshot(QString &fileName, QByteArray &data)
+{
+  if (!m_SnapshotFunc) {
+    return false;
+  }
+  fileName = m_FileName;
+  data = m_SnapshotFunc();
+  return true;
+}
+
 void DelayedFileWriter::doWrite()
 {
-  m_Func();
+  if (m_Func) {
+    m_Func();
+  } else {
+    DelayedFileWriterBase::doWrite();
+  }
+}
+
+
+
+WriteBehindScheduler::WriteBehindScheduler()
+  : m_Timer(this)
+  , m_SyncMode(SYNC_BATCH)
+  , m_ShutDown(false)
+{
+  m_Clock.start();
+  m_Timer.setSingleShot(true);
+  QObject::connect(&m_Timer, &QTimer::timeout, this, &WriteBehindScheduler::timerExpired);
+  // a single thread keeps writes to the same file in order
+  m_IOThread.setMaxThreadCount(1);
+}
+
+WriteBehindScheduler::~WriteBehindScheduler()
+{
+  if (!m_Pending.isEmpty()) {
+    qCritical("%d delayed file writes pending at shutdown", m_Pending.size());
+  }
+  waitForWrites();
+}
+
+WriteBehindScheduler &WriteBehindScheduler::instance()
+{
+  // intentionally never deleted. Writers may still call in during static destruction, long
+  // after the application object and with it the timer are gone
+  static WriteBehindScheduler *s_Instance = []() {
+    WriteBehindScheduler *scheduler = new WriteBehindScheduler();
+    QCoreApplication *application = QCoreApplication::instance();
+    if (application != nullptr) {
+      // the timer has to run on the gui thread, no matter which thread got here first
+      scheduler->moveToThread(application->thread());
+      QObject::connect(application, &QCoreApplication::aboutToQuit,
+                       scheduler, &WriteBehindScheduler::shutdown);
+    } else {
+      qWarning("write-behind scheduler created without an application object");
+    }
+    return scheduler;
+  }();
+  return *s_Instance;
+}
+
+void WriteBehindScheduler::setSyncMode(SyncMode mode)
+{
+  QMutexLocker locker(&m_Mutex);
+  m_SyncMode = mode;
+}
+
+void WriteBehindScheduler::schedule(DelayedFileWriterBase *writer)
+{
+  {
+    QMutexLocker locker(&m_Mutex);
+    if (m_ShutDown) {
+      // there is no event loop to drive the timer anymore
+      locker.unlock();
+      writer->doWrite();
+      return;
+    }
+    qint64 now = m_Clock.elapsed();
+    auto iter = m_Pending.find(writer);
+    qint64 firstRequest = iter != m_Pending.end() ? iter->firstRequest : now;
+    qint64 deadline = now + writer->delay();
+    if (writer->maxLatency() >= 0) {
+      deadline = std::min(deadline, firstRequest + writer->maxLatency());
+    }
+    m_Pending[writer] = { firstRequest, deadline };
+  }
+
+  if (QThread::currentThread() == thread()) {
+    updateTimer();
+  } else {
+    QMetaObject::invokeMethod(this, "updateTimer", Qt::QueuedConnection);
+  }
+}
+
+bool WriteBehindScheduler::isScheduled(DelayedFileWriterBase *writer) const
+{
+  QMutexLocker locker(&m_Mutex);
+  return m_Pending.contains(writer);
+}
+
+void WriteBehindScheduler::cancel(DelayedFileWriterBase *writer)
+{
+  QMutexLocker locker(&m_Mutex);
+  m_Pending.remove(writer);
+  // the timer may fire for nothing, that's cheaper than restarting it here
+}
+
+void WriteBehindScheduler::flush()
+{
+  writeDue(std::numeric_limits<qint64>::max());
+  waitForWrites();
+}
+
+void WriteBehindScheduler::waitForWrites()
+{
+  m_IOThread.waitForDone();
+}
+
+void WriteBehindScheduler::shutdown()
+{
+  {
+    QMutexLocker locker(&m_Mutex);
+    m_ShutDown = true;
+  }
+  m_Timer.stop();
+  flush();
+}
+
+void WriteBehindScheduler::timerExpired()
+{
+  writeDue(m_Clock.elapsed());
+  updateTimer();
+}
+
+void WriteBehindScheduler::updateTimer()
+{
+  QMutexLocker locker(&m_Mutex);
+  if (m_Pending.isEmpty()) {
+    m_Timer.stop();
+    return;
+  }
+  qint64 next = std::numeric_limits<qint64>::max();
+  for (const Pending &pending : m_Pending) {
+    next = std::min(next, pending.deadline);
+  }
+  m_Timer.start(static_cast<int>(std::max<qint64>(0, next - m_Clock.elapsed())));
+}
+
+void WriteBehindScheduler::writeDue(qint64 now)
+{
+  std::vector<DelayedFileWriterBase*> due;
+  SyncMode syncMode;
+  {
+    QMutexLocker locker(&m_Mutex);
+    for (auto iter = m_Pending.begin(); iter != m_Pending.end();) {
+      if (iter->deadline <= now) {
+        due.push_back(iter.key());
+        iter = m_Pending.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+    syncMode = m_SyncMode;
+  }
+
+  // the writers are called without holding the lock, they may schedule the next write already
+  std::vector<WriteItem> items;
+  for (DelayedFileWriterBase *writer : due) {
+    WriteItem item;
+    if (writer->snapshot(item.fileName, item.data)) {
+      items.push_back(std::move(item));
+    } else {
+      writer->doWrite();
+    }
+  }
+
+  if (!items.empty()) {
+    m_IOThread.start(new WriteBatch(std::move(items), syncMode));
+  }
+}
+
+bool WriteBehindScheduler::writeFileAtomic(const QString &fileName, const QByteArray &data, bool sync,
+                                           QString *errorMessage)
+{
+  QFile file(temporaryName(fileName));
+  if (!writeTemporary(file, data, errorMessage)) {
+    return false;
+  }
+  if (sync && !syncFile(file)) {
+    qWarning("failed to flush \"%s\" to disk", qPrintable(fileName));
+  }
+  file.close();
+  return replaceFile(file.fileName(), fileName, sync, errorMessage);
 }
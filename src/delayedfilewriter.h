@@ -3,13 +3,20 @@
 
 
 #include "dllimport.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
 #include <QString>
+#include <QThreadPool>
 #include <QTimer>
 #include <functional>
 
 
 namespace MOBase {
 
+class WriteBehindScheduler;
+
 /**
  * The purpose of this class is to aggregate changes to a file before writing it out
  */
@@ -17,15 +24,21 @@ class QDLLEXPORT DelayedFileWriterBase : public QObject {
 
   Q_OBJECT
 
+  friend class WriteBehindScheduler;
+
 public:
   /**
    * @brief constructor
-   * @param fileName
-   * @param delay delay (in milliseconds) before we call the actual write function
+   * @param delay delay (in milliseconds) after the last call to write() before we write
+   * @param maxLatency maximum time (in milliseconds) between the first call to write() and the
+   *                   actual write, so continuous updates still get written. Negative to disable
    */
-  DelayedFileWriterBase(int delay = 200);
+  DelayedFileWriterBase(int delay = 200, int maxLatency = 2000);
   ~DelayedFileWriterBase();
 
+  int delay() const { return m_TimerDelay; }
+  int maxLatency() const { return m_MaxLatency; }
+
 public slots:
   /**
    * @brief write with delay
@@ -43,27 +56,156 @@ public slots:
    */
   void writeImmediately(bool ifOnTimer);
 
-private slots:
-  void timerExpired();
+protected:
 
-private:
-  virtual void doWrite() = 0;
+  /**
+   * @brief capture the data to be written. This is called on the main thread, the data
+   *        is then written on a background thread through a temporary file that replaces
+   *        the target once complete
+   * @param fileName receives the name of the file to write
+   * @param data receives the content of the file
+   * @return false if this writer doesn't support background writing. doWrite is called
+   *         on the main thread instead. The default implementation returns false
+   */
+  virtual bool snapshot(QString &fileName, QByteArray &data);
+
+  /**
+   * @brief write synchronously. The default implementation writes the snapshot
+   */
+  virtual void doWrite();
 
 private:
   int m_TimerDelay;
-  QTimer m_Timer;
+  int m_MaxLatency;
 };
 
 
 class QDLLEXPORT DelayedFileWriter : public DelayedFileWriterBase {
 public:
   typedef std::function<void()> WriterFunc;
+  typedef std::function<QByteArray()> SnapshotFunc;
 public:
-  DelayedFileWriter(WriterFunc func, int delay = 200);
-private:
-  void doWrite();
+  /**
+   * @param func function that writes the file. Called on the main thread
+   */
+  DelayedFileWriter(WriterFunc func, int delay = 200, int maxLatency = 2000);
+
+  /**
+   * @param fileName the file to write
+   * @param func function that produces the content of the file. Only this is called on the
+   *             main thread, the file is written in the background
+   */
+  DelayedFileWriter(const QString &fileName, SnapshotFunc func, int delay = 200, int maxLatency = 2000);
+protected:
+  virtual bool snapshot(QString &fileName, QByteArray &data) override;
+  virtual void doWrite() override;
 private:
   WriterFunc m_Func;
+  QString m_FileName;
+  SnapshotFunc m_SnapshotFunc;
+};
+
+
+/**
+ * @brief drives all DelayedFileWriters from a single timer and does the actual writing
+ *        on a background thread. The instance lives on the gui thread, schedule() may be
+ *        called from any. When the application is about to quit, everything scheduled
+ *        is written and later writes happen immediately on the calling thread
+ */
+class QDLLEXPORT WriteBehindScheduler : public QObject {
+
+  Q_OBJECT
+
+public:
+
+  enum SyncMode {
+    // files are replaced atomically but not flushed to disk. Safe if the application
+    // crashes, not if the system does
+    SYNC_NONE,
+    // every file is flushed before it replaces the old version
+    SYNC_EACH,
+    // files that are due at the same time are written first and then flushed together
+    SYNC_BATCH
+  };
+
+public:
+
+  WriteBehindScheduler();
+  ~WriteBehindScheduler();
+
+  /**
+   * @return the scheduler used by all writers. The application object should exist when
+   *         this is first called
+   */
+  static WriteBehindScheduler &instance();
+
+  void setSyncMode(SyncMode mode);
+
+  /**
+   * @brief schedule a write, respecting the delay and maximum latency of the writer
+   */
+  void schedule(DelayedFileWriterBase *writer);
+
+  /**
+   * @return true if a write is scheduled for the writer
+   */
+  bool isScheduled(DelayedFileWriterBase *writer) const;
+
+  /**
+   * @brief remove a scheduled write. Writes already passed to the background thread
+   *        are not affected
+   */
+  void cancel(DelayedFileWriterBase *writer);
+
+  /**
+   * @brief write everything that's scheduled now and wait until all writes are complete.
+   *        This should be called before the application exits
+   */
+  void flush();
+
+  /**
+   * @brief wait for the writes that were passed to the background thread
+   */
+  void waitForWrites();
+
+  /**
+   * @brief write a file through a temporary file that atomically replaces the target
+   * @param fileName the file to write
+   * @param data content of the file
+   * @param sync flush the file to disk before it replaces the target
+   * @param errorMessage (optional) receives a description of the problem if the write fails
+   * @return true on success
+   */
+  static bool writeFileAtomic(const QString &fileName, const QByteArray &data, bool sync,
+                              QString *errorMessage = nullptr);
+
+private slots:
+
+  void shutdown();
+  void timerExpired();
+  void updateTimer();
+
+private:
+
+  struct Pending {
+    qint64 firstRequest;
+    qint64 deadline;
+  };
+
+private:
+
+  void writeDue(qint64 now);
+
+private:
+
+  mutable QMutex m_Mutex;
+  QHash<DelayedFileWriterBase*, Pending> m_Pending;
+  QElapsedTimer m_Clock;
+  QTimer m_Timer;
+  QThreadPool m_IOThread;
+  SyncMode m_SyncMode;
+  bool m_ShutDown;
+
 };
 
 }
@@ -0,0 +1,327 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "directoryscanner.h"
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <memory>
+
+#ifdef Q_OS_WIN
+#include "utility.h"
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+
+namespace MOBase {
+
+
+namespace {
+
+struct ScannedFile {
+  QString name;
+  DirectoryScanner::FileInfo info;
+};
+
+/**
+ * a directory as read from disk, before it's turned into a DirectoryTree
+ */
+struct ScannedDirectory {
+  QString name;
+  QString path;
+  std::vector<ScannedFile> files;
+  std::vector<std::unique_ptr<ScannedDirectory>> directories;
+};
+
+struct ScanState {
+  bool withFileInfo;
+  QThreadPool *pool;
+  QMutex errorMutex;
+  QStringList errors;
+
+  void addError(const QString &message)
+  {
+    QMutexLocker locker(&errorMutex);
+    errors.append(message);
+  }
+};
+
+void spawn(ScannedDirectory *directory, ScanState &state);
+
+
+#ifdef Q_OS_WIN
+
+void readDirectory(ScannedDirectory *directory, ScanState &state)
+{
+  WIN32_FIND_DATAW findData;
+  std::wstring pattern = ToWString(QDir::toNativeSeparators(directory->path) + "\\*");
+  HANDLE search = ::FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &findData,
+                                     FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+  if (search == INVALID_HANDLE_VALUE) {
+    DWORD error = ::GetLastError();
+    if (error != ERROR_FILE_NOT_FOUND) {
+      state.addError(QString("%1: %2").arg(directory->path, windowsErrorString(error)));
+    }
+    return;
+  }
+
+  do {
+    QString name = QString::fromWCharArray(findData.cFileName);
+    if ((name == ".") || (name == "..")) {
+      continue;
+    }
+    if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+      if ((findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0) {
+        std::unique_ptr<ScannedDirectory> subDirectory(new ScannedDirectory);
+        subDirectory->name = name;
+        subDirectory->path = directory->path + "/" + name;
+        directory->directories.push_back(std::move(subDirectory));
+      }
+    } else {
+      // size and time come with the enumeration, no reason not to use them
+      ULARGE_INTEGER size;
+      size.LowPart = findData.nFileSizeLow;
+      size.HighPart = findData.nFileSizeHigh;
+      ULARGE_INTEGER time;
+      time.LowPart = findData.ftLastWriteTime.dwLowDateTime;
+      time.HighPart = findData.ftLastWriteTime.dwHighDateTime;
+      // filetime counts 100ns intervals since 1601-01-01
+      qint64 modified = (static_cast<qint64>(time.QuadPart) - Q_INT64_C(116444736000000000)) / 10000;
+      directory->files.push_back({ name, { static_cast<qint64>(size.QuadPart), modified } });
+    }
+  } while (::FindNextFileW(search, &findData));
+
+  ::FindClose(search);
+}
+
+#else // Q_OS_WIN
+
+void addEntry(ScannedDirectory *directory, int dirFd, const char *name, unsigned char type, ScanState &state)
+{
+  if ((name[0] == '.') && ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0')))) {
+    return;
+  }
+
+  struct stat entryStat;
+  bool haveStat = false;
+  if ((type == DT_UNKNOWN) || (type == DT_LNK)) {
+    // the type has to be determined by looking at the file itself. Links to
+    // files are reported as files, links to directories are left out
+    if (::fstatat(dirFd, name, &entryStat, type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+      return;
+    }
+    if (S_ISDIR(entryStat.st_mode)) {
+      type = type == DT_LNK ? DT_LNK : DT_DIR;
+    } else {
+      type = DT_REG;
+      haveStat = true;
+    }
+  }
+
+  QString fileName = QFile::decodeName(name);
+  if (type == DT_DIR) {
+    std::unique_ptr<ScannedDirectory> subDirectory(new ScannedDirectory);
+    subDirectory->name = fileName;
+    subDirectory->path = directory->path + "/" + fileName;
+    directory->directories.push_back(std::move(subDirectory));
+  } else if (type != DT_LNK) {
+    DirectoryScanner::FileInfo info = { 0, 0 };
+    if (state.withFileInfo
+        && (haveStat || (::fstatat(dirFd, name, &entryStat, 0) == 0))) {
+      info.size = entryStat.st_size;
+      info.modified = static_cast<qint64>(entryStat.st_mtim.tv_sec) * 1000 + entryStat.st_mtim.tv_nsec / 1000000;
+    }
+    directory->files.push_back({ fileName, info });
+  }
+}
+
+void readDirectory(ScannedDirectory *directory, ScanState &state)
+{
+  int fd = ::open(QFile::encodeName(directory->path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    QString message = QString::fromLocal8Bit(strerror(errno));
+    state.addError(QString("%1: %2").arg(directory->path, message));
+    return;
+  }
+
+#ifdef __linux__
+  // read entries in large batches straight from the kernel
+  struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+  };
+
+  std::vector<char> buffer(64 * 1024);
+  for (;;) {
+    long count = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+    if (count < 0) {
+      QString message = QString::fromLocal8Bit(strerror(errno));
+      state.addError(QString("%1: %2").arg(directory->path, message));
+      break;
+    } else if (count == 0) {
+      break;
+    }
+    for (long offset = 0; offset < count;) {
+      const LinuxDirent64 *entry = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+      addEntry(directory, fd, entry->d_name, entry->d_type, state);
+      offset += entry->d_reclen;
+    }
+  }
+  ::close(fd);
+#else
+  DIR *dir = ::fdopendir(fd);
+  if (dir == nullptr) {
+    ::close(fd);
+    return;
+  }
+  while (struct dirent *entry = ::readdir(dir)) {
+    addEntry(directory, fd, entry->d_name, entry->d_type, state);
+  }
+  ::closedir(dir);
+#endif
+}
+
+#endif // Q_OS_WIN
+
+
+class ScanJob : public QRunnable {
+public:
+  ScanJob(ScannedDirectory *directory, ScanState &state)
+    : m_Directory(directory), m_State(state)
+  {}
+
+  virtual void run() override
+  {
+    readDirectory(m_Directory, m_State);
+    for (const std::unique_ptr<ScannedDirectory> &subDirectory : m_Directory->directories) {
+      spawn(subDirectory.get(), m_State);
+    }
+  }
+
+private:
+  ScannedDirectory *m_Directory;
+  ScanState &m_State;
+};
+
+void spawn(ScannedDirectory *directory, ScanState &state)
+{
+  state.pool->start(new ScanJob(directory, state));
+}
+
+
+void buildTree(ScannedDirectory &directory, DirectoryTree &node,
+               std::vector<DirectoryScanner::FileInfo> *fileInfo, size_t &nextIndex)
+{
+  std::sort(directory.files.begin(), directory.files.end(),
+            [] (const ScannedFile &lhs, const ScannedFile &rhs) { return lhs.name < rhs.name; });
+  for (const ScannedFile &file : directory.files) {
+    node.addLeaf(FileTreeInformation(file.name, nextIndex++));
+    if (fileInfo != nullptr) {
+      fileInfo->push_back(file.info);
+    }
+  }
+
+  std::sort(directory.directories.begin(), directory.directories.end(),
+            [] (const std::unique_ptr<ScannedDirectory> &lhs, const std::unique_ptr<ScannedDirectory> &rhs) {
+              return lhs->name < rhs->name;
+            });
+  for (const std::unique_ptr<ScannedDirectory> &subDirectory : directory.directories) {
+    DirectoryTree *subNode = new DirectoryTree;
+    subNode->setData(DirectoryTreeInformation(subDirectory->name));
+    buildTree(*subDirectory, *subNode, fileInfo, nextIndex);
+    // names only differing in case end up in the same node, as they would on windows
+    if (node.nodeFind(subNode->getData()) != node.nodesEnd()) {
+      node.addNode(subNode, true);
+      delete subNode;
+    } else {
+      node.addNode(subNode, false);
+    }
+  }
+}
+
+}
+
+
+DirectoryScanner::DirectoryScanner()
+  : m_WithFileInfo(false)
+  , m_MaxThreads(0)
+{
+}
+
+DirectoryScanner &DirectoryScanner::withFileInfo(bool enabled)
+{
+  m_WithFileInfo = enabled;
+  return *this;
+}
+
+DirectoryScanner &DirectoryScanner::withMaxThreads(int maxThreads)
+{
+  m_MaxThreads = maxThreads;
+  return *this;
+}
+
+DirectoryTree *DirectoryScanner::scan(const QString &path)
+{
+  m_FileInfo.clear();
+  m_Errors.clear();
+
+  ScannedDirectory root;
+  root.path = QDir::cleanPath(QDir::fromNativeSeparators(path));
+
+  {
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_MaxThreads > 0 ? m_MaxThreads : QThread::idealThreadCount());
+
+    ScanState state;
+    state.withFileInfo = m_WithFileInfo;
+    state.pool = &pool;
+    spawn(&root, state);
+    // jobs spawn jobs for their sub-directories, the pool is done when the whole tree is
+    pool.waitForDone();
+    m_Errors = state.errors;
+  }
+
+  DirectoryTree *result = new DirectoryTree;
+  result->setData(DirectoryTreeInformation(QString()));
+  size_t nextIndex = 0;
+  buildTree(root, *result, m_WithFileInfo ? &m_FileInfo : nullptr, nextIndex);
+  return result;
+}
+
+} // namespace MOBase
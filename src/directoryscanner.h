@@ -0,0 +1,105 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+
+#include "dllimport.h"
+#include "directorytree.h"
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+
+namespace MOBase {
+
+
+/**
+ * @brief reads a directory structure from disk into a DirectoryTree
+ *
+ * Directories are enumerated with the native API of the platform (getdents64 on linux,
+ * FindFirstFileEx with large fetch on windows) and sub-directories are scanned in parallel.
+ * Symbolic links to directories and junctions are not followed.
+ * @code
+ * DirectoryScanner scanner;
+ * std::unique_ptr<DirectoryTree> tree(scanner.withFileInfo().scan(modPath));
+ * @endcode
+ */
+class QDLLEXPORT DirectoryScanner
+{
+public:
+
+  /**
+   * @brief size and modification time of a file
+   */
+  struct FileInfo {
+    qint64 size;
+    // milliseconds since the epoch (UTC)
+    qint64 modified;
+  };
+
+public:
+
+  DirectoryScanner();
+
+  /**
+   * @brief also collect size and modification time of each file. On linux this costs
+   *        one stat per file, on windows the information comes with the enumeration
+   */
+  DirectoryScanner &withFileInfo(bool enabled = true);
+
+  /**
+   * @brief limit the number of directories scanned at the same time. 0 uses one thread per core
+   */
+  DirectoryScanner &withMaxThreads(int maxThreads);
+
+  /**
+   * @brief scan a directory
+   * @param path the directory to scan
+   * @return the tree. The root node represents path itself and has an empty name. The
+   *         caller takes custody of the pointer. Leaf indices are assigned in order starting
+   *         at 0, directories are sorted by name, files by name within their directory
+   */
+  DirectoryTree *scan(const QString &path);
+
+  /**
+   * @return information about the files of the last scan, indexed by
+   *         FileTreeInformation::getIndex(). Empty unless withFileInfo was used
+   */
+  const std::vector<FileInfo> &fileInfo() const { return m_FileInfo; }
+
+  /**
+   * @return directories that couldn't be read during the last scan
+   */
+  const QStringList &errors() const { return m_Errors; }
+
+private:
+
+  bool m_WithFileInfo;
+  int m_MaxThreads;
+  std::vector<FileInfo> m_FileInfo;
+  QStringList m_Errors;
+
+};
+
+} // namespace MOBase
+
+#endif // DIRECTORYSCANNER_H
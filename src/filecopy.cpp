@@ -0,0 +1,603 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "filecopy.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QObject>
+#include <QSet>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include "utility.h"
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/syscall.h>
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#endif
+#endif
+
+
+namespace MOBase {
+
+
+double CopyReport::throughput() const
+{
+  if (elapsedMs <= 0) {
+    return 0.0;
+  }
+  return static_cast<double>(bytesCopied) * 1000.0 / static_cast<double>(elapsedMs);
+}
+
+
+#ifdef Q_OS_WIN
+
+static bool copyFileImpl(const QString &source, const QString &destination, QString *errorMessage,
+                         qint64 *bytesCopied, bool *cloned)
+{
+  // CopyFile lets the file system copy the data without passing it through user space.
+  // Whether it shared blocks (ReFS block cloning) isn't reported so this always counts as a copy
+  *cloned = false;
+  if (!::CopyFileW(ToWString(QDir::toNativeSeparators(source)).c_str(),
+                   ToWString(QDir::toNativeSeparators(destination)).c_str(), TRUE)) {
+    if (errorMessage != nullptr) {
+      *errorMessage = windowsErrorString(::GetLastError());
+    }
+    return false;
+  }
+  if (bytesCopied != nullptr) {
+    *bytesCopied = QFileInfo(destination).size();
+  }
+  return true;
+}
+
+#else // Q_OS_WIN
+
+static bool copyFileContent(int in, int out, qint64 size, QString *errorMessage, bool *cloned)
+{
+#ifdef FICLONE
+  // on file systems that support it (btrfs, xfs, ...) the copy shares the data blocks
+  if (::ioctl(out, FICLONE, in) == 0) {
+    *cloned = true;
+    return true;
+  }
+#endif
+
+  qint64 remaining = size;
+
+#ifdef __linux__
+  while (remaining > 0) {
+    ssize_t res = ::copy_file_range(in, nullptr, out, nullptr, static_cast<size_t>(remaining), 0);
+    if (res > 0) {
+      remaining -= res;
+    } else if ((res < 0) && (errno == EINTR)) {
+      continue;
+    } else {
+      // not supported between these files (i.e. different file systems on older
+      // kernels), fall back to a regular copy of whatever is left
+      break;
+    }
+  }
+  if (remaining <= 0) {
+    return true;
+  }
+  off_t offset = static_cast<off_t>(size - remaining);
+  if ((::lseek(in, offset, SEEK_SET) != offset) || (::lseek(out, offset, SEEK_SET) != offset)) {
+    if (errorMessage != nullptr) {
+      *errorMessage = QString::fromLocal8Bit(strerror(errno));
+    }
+    return false;
+  }
+#endif
+
+  std::vector<char> buffer(1024 * 1024);
+  for (;;) {
+    ssize_t bytesRead = ::read(in, buffer.data(), buffer.size());
+    if (bytesRead == 0) {
+      return true;
+    } else if (bytesRead < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    const char *pos = buffer.data();
+    while (bytesRead > 0) {
+      ssize_t bytesWritten = ::write(out, pos, static_cast<size_t>(bytesRead));
+      if (bytesWritten < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errorMessage != nullptr) {
+          *errorMessage = QString::fromLocal8Bit(strerror(errno));
+        }
+        return false;
+      }
+      pos += bytesWritten;
+      bytesRead -= bytesWritten;
+    }
+  }
+
+  if (errorMessage != nullptr) {
+    *errorMessage = QString::fromLocal8Bit(strerror(errno));
+  }
+  return false;
+}
+
+static bool copyFileImpl(const QString &source, const QString &destination, QString *errorMessage,
+                         qint64 *bytesCopied, bool *cloned)
+{
+  *cloned = false;
+  int in = ::open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    if (errorMessage != nullptr) {
+      *errorMessage = QString::fromLocal8Bit(strerror(errno));
+    }
+    return false;
+  }
+
+  struct stat sourceStat;
+  if (::fstat(in, &sourceStat) != 0) {
+    if (errorMessage != nullptr) {
+      *errorMessage = QString::fromLocal8Bit(strerror(errno));
+    }
+    ::close(in);
+    return false;
+  }
+
+  QByteArray destinationName = QFile::encodeName(destination);
+  int out = ::open(destinationName.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                   sourceStat.st_mode & 0777);
+  if (out < 0) {
+    if (errorMessage != nullptr) {
+      *errorMessage = QString::fromLocal8Bit(strerror(errno));
+    }
+    ::close(in);
+    return false;
+  }
+
+  bool success = copyFileContent(in, out, sourceStat.st_size, errorMessage, cloned);
+  if (success) {
+    // keep the modification time like CopyFile does on windows
+    struct timespec times[2] = { sourceStat.st_atim, sourceStat.st_mtim };
+    ::futimens(out, times);
+  }
+
+  ::close(in);
+  if ((::close(out) != 0) && success) {
+    if (errorMessage != nullptr) {
+      *errorMessage = QString::fromLocal8Bit(strerror(errno));
+    }
+    success = false;
+  }
+
+  if (!success) {
+    ::unlink(destinationName.constData());
+  } else if (bytesCopied != nullptr) {
+    *bytesCopied = sourceStat.st_size;
+  }
+  return success;
+}
+
+#endif // Q_OS_WIN
+
+
+bool copyFileFast(const QString &source, const QString &destination, QString *errorMessage, qint64 *bytesCopied)
+{
+  bool cloned;
+  return copyFileImpl(source, destination, errorMessage, bytesCopied, &cloned);
+}
+
+
+/**
+ * create a hard link at destination. fallback is set if the link failed in a way that
+ * a copy might still succeed (different volume, file system without links, link limit reached)
+ */
+static bool createHardLink(const QString &source, const QString &destination, QString *errorMessage, bool *fallback)
+{
+#ifdef Q_OS_WIN
+  if (::CreateHardLinkW(ToWString(QDir::toNativeSeparators(destination)).c_str(),
+                        ToWString(QDir::toNativeSeparators(source)).c_str(), nullptr)) {
+    return true;
+  }
+  DWORD error = ::GetLastError();
+  *fallback = (error != ERROR_ALREADY_EXISTS) && (error != ERROR_FILE_EXISTS)
+              && (error != ERROR_FILE_NOT_FOUND) && (error != ERROR_PATH_NOT_FOUND);
+  if (errorMessage != nullptr) {
+    *errorMessage = windowsErrorString(error);
+  }
+  return false;
+#else
+  if (::link(QFile::encodeName(source).constData(), QFile::encodeName(destination).constData()) == 0) {
+    return true;
+  }
+  int error = errno;
+  *fallback = (error == EXDEV) || (error == EPERM) || (error == EMLINK) || (error == ENOTSUP);
+  if (errorMessage != nullptr) {
+    *errorMessage = QString::fromLocal8Bit(strerror(error));
+  }
+  return false;
+#endif
+}
+
+
+bool deployFile(const QString &source, const QString &destination, DeployMode mode,
+                DeployMethod *method, QString *errorMessage, qint64 *bytesCopied)
+{
+  if (mode == DeployMode::Link) {
+    bool fallback = false;
+    if (createHardLink(source, destination, errorMessage, &fallback)) {
+      if (method != nullptr) {
+        *method = DeployMethod::Hardlinked;
+      }
+      if (bytesCopied != nullptr) {
+        *bytesCopied = 0;
+      }
+      return true;
+    } else if (!fallback) {
+      return false;
+    }
+  }
+
+  bool cloned = false;
+  qint64 size = 0;
+  if (!copyFileImpl(source, destination, errorMessage, &size, &cloned)) {
+    return false;
+  }
+  if (method != nullptr) {
+    *method = cloned ? DeployMethod::Reflinked : DeployMethod::Copied;
+  }
+  if (bytesCopied != nullptr) {
+    *bytesCopied = cloned ? 0 : size;
+  }
+  return true;
+}
+
+
+#ifndef Q_OS_WIN
+/**
+ * rename that fails with EEXIST instead of replacing the destination, like MoveFileEx
+ * does without MOVEFILE_REPLACE_EXISTING
+ */
+static int renameNoReplace(const char *source, const char *destination)
+{
+#if defined(__linux__) && defined(SYS_renameat2)
+  if (::syscall(SYS_renameat2, AT_FDCWD, source, AT_FDCWD, destination, RENAME_NOREPLACE) == 0) {
+    return 0;
+  }
+  // older kernels and some file systems don't support the flag
+  if ((errno != ENOSYS) && (errno != EINVAL)) {
+    return -1;
+  }
+#endif
+
+  // creating the link fails atomically if the destination exists
+  if (::link(source, destination) == 0) {
+    if (::unlink(source) != 0) {
+      int error = errno;
+      ::unlink(destination);
+      errno = error;
+      return -1;
+    }
+    return 0;
+  }
+  if ((errno == EEXIST) || (errno == EXDEV) || (errno == ENOENT)) {
+    return -1;
+  }
+
+  // no hard links on this file system, there is nothing atomic left to use
+  struct stat destinationStat;
+  if (::lstat(destination, &destinationStat) == 0) {
+    errno = EEXIST;
+    return -1;
+  }
+  return ::rename(source, destination);
+}
+#endif
+
+
+static bool moveFileImpl(const QString &source, const QString &destination, QString *errorMessage,
+                         qint64 *bytesCopied, DeployMethod *method)
+{
+  *bytesCopied = 0;
+  *method = DeployMethod::Moved;
+#ifdef Q_OS_WIN
+  if (::MoveFileExW(ToWString(QDir::toNativeSeparators(source)).c_str(),
+                    ToWString(QDir::toNativeSeparators(destination)).c_str(), 0)) {
+    return true;
+  }
+  DWORD error = ::GetLastError();
+  if (error != ERROR_NOT_SAME_DEVICE) {
+    if (errorMessage != nullptr) {
+      *errorMessage = windowsErrorString(error);
+    }
+    return false;
+  }
+#else
+  // rename would silently replace the file, that's not how it works on windows
+  if (renameNoReplace(QFile::encodeName(source).constData(), QFile::encodeName(destination).constData()) == 0) {
+    return true;
+  }
+  if (errno != EXDEV) {
+    if (errorMessage != nullptr) {
+      *errorMessage = QString::fromLocal8Bit(strerror(errno));
+    }
+    return false;
+  }
+#endif
+
+  // source and destination are on different volumes
+  if (!deployFile(source, destination, DeployMode::Copy, method, errorMessage, bytesCopied)) {
+    return false;
+  }
+  if (!QFile::remove(source)) {
+    qWarning("failed to remove \"%s\" after copying it", qPrintable(source));
+  }
+  return true;
+}
+
+
+bool moveFileFast(const QString &source, const QString &destination, QString *errorMessage, qint64 *bytesCopied)
+{
+  qint64 bytes = 0;
+  DeployMethod method;
+  bool success = moveFileImpl(source, destination, errorMessage, &bytes, &method);
+  if (bytesCopied != nullptr) {
+    *bytesCopied = bytes;
+  }
+  return success;
+}
+
+
+namespace {
+
+struct CopyItem {
+  QString source;
+  QString destination;
+};
+
+/**
+ * shared state of a parallel copy
+ */
+struct CopyState {
+  CopyState(TransferMode mode, DeployMode deployMode)
+    : mode(mode), deployMode(deployMode), filesCopied(0), bytesCopied(0) {}
+
+  TransferMode mode;
+  DeployMode deployMode;
+  std::atomic<int> filesCopied;
+  std::atomic<qint64> bytesCopied;
+  // protects errors and deployed
+  QMutex errorMutex;
+  QList<FileCopyError> errors;
+  QList<DeployedFile> deployed;
+};
+
+/**
+ * copies a batch of files
+ */
+class CopyBatch : public QRunnable {
+public:
+  CopyBatch(const std::vector<CopyItem> &items, size_t begin, size_t end, CopyState &state)
+    : m_Items(items), m_Begin(begin), m_End(end), m_State(state)
+  {}
+
+  virtual void run()
+  {
+    QList<DeployedFile> deployed;
+    for (size_t i = m_Begin; i < m_End; ++i) {
+      const CopyItem &item = m_Items[i];
+      QString errorMessage;
+      qint64 bytes = 0;
+      DeployMethod method;
+      bool success = m_State.mode == TransferMode::Move
+                     ? moveFileImpl(item.source, item.destination, &errorMessage, &bytes, &method)
+                     : deployFile(item.source, item.destination, m_State.deployMode, &method, &errorMessage, &bytes);
+      if (success) {
+        ++m_State.filesCopied;
+        m_State.bytesCopied += bytes;
+        deployed.append({ item.source, item.destination, method });
+      } else {
+        QMutexLocker locker(&m_State.errorMutex);
+        m_State.errors.append({ item.source, item.destination, errorMessage });
+      }
+    }
+    // collected per batch so the lock isn't taken for every file
+    QMutexLocker locker(&m_State.errorMutex);
+    m_State.deployed.append(deployed);
+  }
+
+private:
+  const std::vector<CopyItem> &m_Items;
+  size_t m_Begin;
+  size_t m_End;
+  CopyState &m_State;
+};
+
+/**
+ * process all items, in small batches so threads that drew large files don't hold up the rest
+ */
+void runBatches(const std::vector<CopyItem> &items, CopyState &state, int maxThreads)
+{
+  if (maxThreads <= 0) {
+    maxThreads = QThread::idealThreadCount();
+  }
+
+  static const size_t BatchSize = 16;
+  if ((maxThreads <= 1) || (items.size() <= BatchSize)) {
+    CopyBatch(items, 0, items.size(), state).run();
+  } else {
+    QThreadPool pool;
+    pool.setMaxThreadCount(maxThreads);
+    for (size_t begin = 0; begin < items.size(); begin += BatchSize) {
+      pool.start(new CopyBatch(items, begin, std::min(begin + BatchSize, items.size()), state));
+    }
+    pool.waitForDone();
+  }
+}
+
+void fillReport(const CopyState &state, const QElapsedTimer &timer, CopyReport *report)
+{
+  if (report != nullptr) {
+    report->filesCopied = state.filesCopied.load();
+    report->bytesCopied = state.bytesCopied.load();
+    report->elapsedMs = timer.elapsed();
+    report->errors = state.errors;
+    report->deployed = state.deployed;
+    // batches finish in any order
+    std::sort(report->deployed.begin(), report->deployed.end(),
+              [] (const DeployedFile &lhs, const DeployedFile &rhs) {
+                return lhs.destination < rhs.destination;
+              });
+  }
+}
+
+}
+
+
+bool copyDirParallel(const QString &sourceName, const QString &destinationName, bool merge,
+                     CopyReport *report, int maxThreads, DeployMode deployMode)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  QDir sourceDir(sourceName);
+  if (!sourceDir.exists()) {
+    return false;
+  }
+  QDir destDir(destinationName);
+  if (!destDir.exists()) {
+    if (!destDir.mkpath(".")) {
+      return false;
+    }
+  } else if (!merge) {
+    return false;
+  }
+
+  QString sourceBase = sourceDir.absolutePath();
+  QString destinationBase = destDir.absolutePath();
+
+  // enumerate everything once, creating the directory structure on the way so
+  // the workers only have to deal with files
+  std::vector<CopyItem> items;
+  QList<FileCopyError> errors;
+  QDirIterator iter(sourceBase, QDir::Files | QDir::AllDirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+                    QDirIterator::Subdirectories);
+  while (iter.hasNext()) {
+    iter.next();
+    QFileInfo info = iter.fileInfo();
+    QString destination = destinationBase + iter.filePath().mid(sourceBase.length());
+    if (info.isDir()) {
+      // we leave out symlinks because that could cause an endless recursion
+      if (!info.isSymLink() && !QDir().mkpath(destination)) {
+        errors.append({ info.filePath(), destination, QObject::tr("failed to create directory") });
+      }
+    } else {
+      items.push_back({ info.filePath(), destination });
+    }
+  }
+
+  CopyState state(TransferMode::Copy, deployMode);
+  state.errors = errors;
+  runBatches(items, state, maxThreads);
+  fillReport(state, timer, report);
+
+  return true;
+}
+
+
+bool transferFiles(const QList<FileTransfer> &files, const QString &baseDir, TransferMode mode,
+                   CopyReport *report, int maxThreads, DeployMode deployMode)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  QString base = QDir::fromNativeSeparators(baseDir);
+  while (base.endsWith('/')) {
+    base.chop(1);
+  }
+
+  std::vector<CopyItem> items;
+  items.reserve(files.size());
+  foreach (const FileTransfer &file, files) {
+    items.push_back({ file.source, base + "/" + QDir::fromNativeSeparators(file.destination) });
+  }
+  // files in the same directory end up next to each other
+  std::sort(items.begin(), items.end(), [] (const CopyItem &lhs, const CopyItem &rhs) {
+    return lhs.destination < rhs.destination;
+  });
+
+  CopyState state(mode, deployMode);
+
+  // create every target directory exactly once. Directories known to exist are
+  // remembered including their parents so siblings and children don't hit the disk again
+  QSet<QString> existingDirs;
+  existingDirs.insert(base);
+  QString failedDir;
+  std::vector<CopyItem> ready;
+  ready.reserve(items.size());
+  for (const CopyItem &item : items) {
+    QString dir = item.destination.left(item.destination.lastIndexOf('/'));
+    if (!existingDirs.contains(dir)) {
+      if (!failedDir.isEmpty() && (dir == failedDir)) {
+        state.errors.append({ item.source, item.destination, QObject::tr("failed to create directory") });
+        continue;
+      }
+      if (!QDir().mkpath(dir)) {
+        failedDir = dir;
+        state.errors.append({ item.source, item.destination, QObject::tr("failed to create directory") });
+        continue;
+      }
+      for (QString parent = dir; !existingDirs.contains(parent) && (parent.length() > base.length());
+           parent.truncate(parent.lastIndexOf('/'))) {
+        existingDirs.insert(parent);
+      }
+    }
+    ready.push_back(item);
+  }
+
+  runBatches(ready, state, maxThreads);
+  fillReport(state, timer, report);
+
+  return state.errors.isEmpty();
+}
+
+} // namespace MOBase
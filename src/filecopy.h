@@ -0,0 +1,194 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef FILECOPY_H
+#define FILECOPY_H
+
+
+#include "dllimport.h"
+#include <QString>
+#include <QList>
+
+
+namespace MOBase {
+
+
+/**
+ * @brief a file that couldn't be copied
+ */
+struct FileCopyError {
+  QString source;
+  QString destination;
+  QString message;
+};
+
+
+/**
+ * @brief a file to transfer with transferFiles
+ */
+struct FileTransfer {
+  QString source;
+  // path relative to the base directory
+  QString destination;
+};
+
+
+enum class TransferMode {
+  Copy,
+  Move
+};
+
+
+/**
+ * @brief how copies of a file are created
+ */
+enum class DeployMode {
+  // always create an independent copy. Where the file system supports it
+  // (btrfs, xfs, ...) the copy shares data blocks with the original until either is changed
+  Copy,
+  // create a hard link if source and destination are on the same volume, copy otherwise.
+  // The link refers to the same data as the source so changes to either affect both
+  Link
+};
+
+
+/**
+ * @brief how a file was actually deployed
+ */
+enum class DeployMethod {
+  Copied,
+  // copy that shares data blocks with the source, no data was copied
+  Reflinked,
+  Hardlinked,
+  // renamed as part of a move
+  Moved
+};
+
+
+/**
+ * @brief a file that was successfully transferred
+ */
+struct DeployedFile {
+  QString source;
+  QString destination;
+  DeployMethod method;
+};
+
+
+/**
+ * @brief summary of a copy operation
+ */
+struct QDLLEXPORT CopyReport {
+  CopyReport() : filesCopied(0), bytesCopied(0), elapsedMs(0) {}
+
+  /**
+   * @return average throughput in bytes per second
+   */
+  double throughput() const;
+
+  int filesCopied;
+  // only counts data that actually had to be copied, not files that were renamed or linked
+  qint64 bytesCopied;
+  qint64 elapsedMs;
+  QList<FileCopyError> errors;
+  // every file that was transferred and how, sorted by destination
+  QList<DeployedFile> deployed;
+};
+
+
+/**
+ * @brief copy a single file using the most efficient mechanism of the platform
+ *        (CopyFile on windows, reflink or copy_file_range on linux). Existing files
+ *        are not overwritten
+ * @param source name of the file to copy
+ * @param destination name of the copy
+ * @param errorMessage (optional) receives a description of the problem if the copy fails
+ * @param bytesCopied (optional) receives the size of the copied file
+ * @return true on success
+ */
+QDLLEXPORT bool copyFileFast(const QString &source, const QString &destination,
+                             QString *errorMessage = nullptr, qint64 *bytesCopied = nullptr);
+
+/**
+ * @brief move a single file. If source and destination are on different volumes
+ *        the file is copied and the source removed. Existing files are not overwritten
+ * @param source name of the file to move
+ * @param destination new name of the file
+ * @param errorMessage (optional) receives a description of the problem if the move fails
+ * @param bytesCopied (optional) receives the size of the file if it had to be copied, 0 otherwise
+ * @return true on success
+ */
+QDLLEXPORT bool moveFileFast(const QString &source, const QString &destination,
+                             QString *errorMessage = nullptr, qint64 *bytesCopied = nullptr);
+
+/**
+ * @brief create a copy of a file using the cheapest mechanism allowed by mode. Existing
+ *        files are not overwritten
+ * @param source name of the file to copy
+ * @param destination name of the copy
+ * @param mode whether the copy may be a hard link to the source
+ * @param method (optional) receives how the file was deployed
+ * @param errorMessage (optional) receives a description of the problem if the copy fails
+ * @param bytesCopied (optional) receives the amount of data that had to be copied, 0 for links
+ * @return true on success
+ * @note if a hard link can't be created for any reason other than an existing destination,
+ *       the file is copied instead
+ */
+QDLLEXPORT bool deployFile(const QString &source, const QString &destination, DeployMode mode,
+                           DeployMethod *method = nullptr, QString *errorMessage = nullptr,
+                           qint64 *bytesCopied = nullptr);
+
+/**
+ * @brief copy a directory recursively, copying files on multiple threads
+ * @param sourceName name of the directory to copy
+ * @param destinationName name of the target directory
+ * @param merge if true, the destination directory is allowed to exist, files will then
+ *              be added to that directory. If false, the call will fail in that case
+ * @param report (optional) receives statistics and a list of all files that failed to copy
+ * @param maxThreads maximum number of threads to use. 0 uses one thread per core
+ * @param deployMode whether files may be hard linked instead of copied
+ * @return true if the directory was copied. Files that failed to copy are listed in
+ *         report but don't cause this to return false
+ * @note the source is enumerated completely and the directory structure created before
+ *       any file is copied. symbolic links to directories are not followed
+ */
+QDLLEXPORT bool copyDirParallel(const QString &sourceName, const QString &destinationName, bool merge,
+                                CopyReport *report = nullptr, int maxThreads = 0,
+                                DeployMode deployMode = DeployMode::Copy);
+
+/**
+ * @brief move or copy a list of files into a directory, creating sub-directories as needed
+ * @param files the files to transfer. destinations are relative to baseDir
+ * @param baseDir the directory the destinations are relative to
+ * @param mode whether to copy or move the files. Moves are done as renames where possible
+ * @param report (optional) receives statistics and a list of all files that failed to transfer
+ * @param maxThreads maximum number of threads to use. 0 uses one thread per core
+ * @param deployMode whether copied files may be hard linked. Ignored for moves
+ * @return true if all files were transferred
+ * @note each target directory is created only once no matter how many files go there. Files
+ *       are transferred on multiple threads after all directories were created
+ */
+QDLLEXPORT bool transferFiles(const QList<FileTransfer> &files, const QString &baseDir, TransferMode mode,
+                              CopyReport *report = nullptr, int maxThreads = 0,
+                              DeployMode deployMode = DeployMode::Copy);
+
+} // namespace MOBase
+
+#endif // FILECOPY_H
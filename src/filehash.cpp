@@ -0,0 +1,577 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "filehash.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+namespace MOBase {
+
+
+namespace {
+
+/**
+ * incremental hash computation
+ */
+class Digest {
+public:
+  virtual ~Digest() {}
+  virtual void add(const char *data, qint64 size) = 0;
+  virtual QByteArray result() = 0;
+};
+
+
+QByteArray toBigEndian(quint64 value, int bytes)
+{
+  QByteArray result(bytes, '\0');
+  for (int i = bytes - 1; i >= 0; --i) {
+    result[i] = static_cast<char>(value & 0xFF);
+    value >>= 8;
+  }
+  return result;
+}
+
+
+/**
+ * XXH64 as specified at https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ */
+class Xxh64Digest : public Digest {
+public:
+  Xxh64Digest()
+    : m_TotalLength(0), m_BufferSize(0)
+  {
+    m_Accumulators[0] = Prime1 + Prime2;
+    m_Accumulators[1] = Prime2;
+    m_Accumulators[2] = 0;
+    m_Accumulators[3] = 0 - Prime1;
+  }
+
+  virtual void add(const char *data, qint64 size) override
+  {
+    const unsigned char *pos = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char *end = pos + size;
+    m_TotalLength += static_cast<quint64>(size);
+
+    if (m_BufferSize > 0) {
+      size_t missing = std::min<size_t>(StripeSize - m_BufferSize, end - pos);
+      memcpy(m_Buffer + m_BufferSize, pos, missing);
+      m_BufferSize += missing;
+      pos += missing;
+      if (m_BufferSize < StripeSize) {
+        return;
+      }
+      consumeStripe(m_Buffer);
+      m_BufferSize = 0;
+    }
+
+    while (end - pos >= static_cast<qint64>(StripeSize)) {
+      consumeStripe(pos);
+      pos += StripeSize;
+    }
+
+    memcpy(m_Buffer, pos, end - pos);
+    m_BufferSize = end - pos;
+  }
+
+  virtual QByteArray result() override
+  {
+    quint64 hash;
+    if (m_TotalLength >= StripeSize) {
+      hash = rotateLeft(m_Accumulators[0], 1) + rotateLeft(m_Accumulators[1], 7)
+           + rotateLeft(m_Accumulators[2], 12) + rotateLeft(m_Accumulators[3], 18);
+      for (int i = 0; i < 4; ++i) {
+        hash = (hash ^ round(0, m_Accumulators[i])) * Prime1 + Prime4;
+      }
+    } else {
+      hash = Prime5;
+    }
+    hash += m_TotalLength;
+
+    const unsigned char *pos = m_Buffer;
+    const unsigned char *end = m_Buffer + m_BufferSize;
+    for (; end - pos >= 8; pos += 8) {
+      hash ^= round(0, read64(pos));
+      hash = rotateLeft(hash, 27) * Prime1 + Prime4;
+    }
+    if (end - pos >= 4) {
+      hash ^= static_cast<quint64>(read32(pos)) * Prime1;
+      hash = rotateLeft(hash, 23) * Prime2 + Prime3;
+      pos += 4;
+    }
+    for (; pos < end; ++pos) {
+      hash ^= (*pos) * Prime5;
+      hash = rotateLeft(hash, 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return toBigEndian(hash, 8);
+  }
+
+private:
+
+  static const quint64 Prime1 = Q_UINT64_C(0x9E3779B185EBCA87);
+  static const quint64 Prime2 = Q_UINT64_C(0xC2B2AE3D27D4EB4F);
+  static const quint64 Prime3 = Q_UINT64_C(0x165667B19E3779F9);
+  static const quint64 Prime4 = Q_UINT64_C(0x85EBCA77C2B2AE63);
+  static const quint64 Prime5 = Q_UINT64_C(0x27D4EB2F165667C5);
+  static const size_t StripeSize = 32;
+
+private:
+
+  static quint64 rotateLeft(quint64 value, int bits)
+  {
+    return (value << bits) | (value >> (64 - bits));
+  }
+
+  static quint64 round(quint64 accumulator, quint64 input)
+  {
+    accumulator += input * Prime2;
+    return rotateLeft(accumulator, 31) * Prime1;
+  }
+
+  // the specification uses little endian, which all platforms we build for are
+  static quint64 read64(const unsigned char *data)
+  {
+    quint64 result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+  }
+
+  static quint32 read32(const unsigned char *data)
+  {
+    quint32 result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+  }
+
+  void consumeStripe(const unsigned char *data)
+  {
+    for (int i = 0; i < 4; ++i) {
+      m_Accumulators[i] = round(m_Accumulators[i], read64(data + i * 8));
+    }
+  }
+
+private:
+
+  quint64 m_Accumulators[4];
+  quint64 m_TotalLength;
+  unsigned char m_Buffer[StripeSize];
+  size_t m_BufferSize;
+
+};
+
+
+/**
+ * CRC-32 (IEEE 802.3), processing 8 bytes per step with the slicing-by-8 tables
+ */
+class Crc32Digest : public Digest {
+public:
+  Crc32Digest()
+    : m_Crc(0xFFFFFFFFu)
+  {}
+
+  virtual void add(const char *data, qint64 size) override
+  {
+    const Tables &tables = getTables();
+    const unsigned char *pos = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char *end = pos + size;
+    quint32 crc = m_Crc;
+
+    while (end - pos >= 8) {
+      quint32 low;
+      quint32 high;
+      memcpy(&low, pos, 4);
+      memcpy(&high, pos + 4, 4);
+      low ^= crc;
+      crc = tables.t[7][low & 0xFF] ^ tables.t[6][(low >> 8) & 0xFF]
+          ^ tables.t[5][(low >> 16) & 0xFF] ^ tables.t[4][low >> 24]
+          ^ tables.t[3][high & 0xFF] ^ tables.t[2][(high >> 8) & 0xFF]
+          ^ tables.t[1][(high >> 16) & 0xFF] ^ tables.t[0][high >> 24];
+      pos += 8;
+    }
+    for (; pos < end; ++pos) {
+      crc = tables.t[0][(crc ^ *pos) & 0xFF] ^ (crc >> 8);
+    }
+
+    m_Crc = crc;
+  }
+
+  virtual QByteArray result() override
+  {
+    return toBigEndian(m_Crc ^ 0xFFFFFFFFu, 4);
+  }
+
+private:
+
+  struct Tables {
+    quint32 t[8][256];
+  };
+
+  static const Tables &getTables()
+  {
+    static const Tables tables = createTables();
+    return tables;
+  }
+
+  static Tables createTables()
+  {
+    Tables result;
+    for (quint32 i = 0; i < 256; ++i) {
+      quint32 crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320u : 0u);
+      }
+      result.t[0][i] = crc;
+    }
+    for (quint32 i = 0; i < 256; ++i) {
+      for (int slice = 1; slice < 8; ++slice) {
+        quint32 previous = result.t[slice - 1][i];
+        result.t[slice][i] = (previous >> 8) ^ result.t[0][previous & 0xFF];
+      }
+    }
+    return result;
+  }
+
+private:
+
+  quint32 m_Crc;
+
+};
+
+
+class Md5Digest : public Digest {
+public:
+  Md5Digest()
+    : m_Hash(QCryptographicHash::Md5)
+  {}
+
+  virtual void add(const char *data, qint64 size) override
+  {
+    m_Hash.addData(data, static_cast<int>(size));
+  }
+
+  virtual QByteArray result() override
+  {
+    return m_Hash.result();
+  }
+
+private:
+
+  QCryptographicHash m_Hash;
+
+};
+
+
+std::unique_ptr<Digest> createDigest(FileHasher::Algorithm algorithm)
+{
+  switch (algorithm) {
+    case FileHasher::ALGORITHM_CRC32: return std::unique_ptr<Digest>(new Crc32Digest);
+    case FileHasher::ALGORITHM_MD5:   return std::unique_ptr<Digest>(new Md5Digest);
+    default:                          return std::unique_ptr<Digest>(new Xxh64Digest);
+  }
+}
+
+
+const quint32 CACHE_MAGIC = 0x4D4F4843; // "MOHC"
+const quint16 CACHE_VERSION = 1;
+
+// files are mapped and hashed in windows of this size so huge files don't
+// need a huge chunk of address space
+const qint64 MAP_WINDOW = 16 * 1024 * 1024;
+const qint64 READ_BLOCK = 1024 * 1024;
+
+
+/**
+ * hashes one file on the pool
+ */
+class HashJob : public QRunnable {
+public:
+  HashJob(std::function<void ()> work)
+    : m_Work(work)
+  {}
+
+  virtual void run() override
+  {
+    m_Work();
+  }
+
+private:
+  std::function<void ()> m_Work;
+};
+
+}
+
+
+FileHasher::FileHasher(const QString &cacheFile, int maxThreads)
+  : m_CacheFile(cacheFile)
+  , m_MaxThreads(maxThreads > 0 ? maxThreads : QThread::idealThreadCount())
+  , m_CacheDirty(false)
+{
+  m_Statistics.cacheHits = 0;
+  m_Statistics.filesHashed = 0;
+  m_Statistics.bytesHashed = 0;
+  loadCache();
+}
+
+FileHasher::~FileHasher()
+{
+  saveCache();
+}
+
+QString FileHasher::cacheKey(const QString &filePath, Algorithm algorithm)
+{
+  QString path = QDir::cleanPath(QFileInfo(filePath).absoluteFilePath());
+#ifdef Q_OS_WIN
+  path = path.toLower();
+#endif
+  return QString::number(algorithm) + ":" + path;
+}
+
+QByteArray FileHasher::hashData(const char *data, qint64 size, Algorithm algorithm)
+{
+  std::unique_ptr<Digest> digest = createDigest(algorithm);
+  for (qint64 offset = 0; offset < size; offset += MAP_WINDOW) {
+    digest->add(data + offset, std::min(MAP_WINDOW, size - offset));
+  }
+  return digest->result();
+}
+
+QByteArray FileHasher::hashFile(const QString &filePath, Algorithm algorithm, qint64 *bytesRead)
+{
+  *bytesRead = 0;
+  QFile file(filePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QByteArray();
+  }
+
+  std::unique_ptr<Digest> digest = createDigest(algorithm);
+  qint64 size = file.size();
+  qint64 offset = 0;
+
+  // prefer mapping, that saves copying the data. Where that isn't possible read
+  // sequentially in large blocks
+  while (offset < size) {
+    qint64 length = std::min(MAP_WINDOW, size - offset);
+    uchar *mapped = file.map(offset, length);
+    if (mapped == nullptr) {
+      break;
+    }
+    digest->add(reinterpret_cast<const char*>(mapped), length);
+    file.unmap(mapped);
+    offset += length;
+  }
+
+  if (offset < size) {
+    if (!file.seek(offset)) {
+      return QByteArray();
+    }
+    std::vector<char> buffer(READ_BLOCK);
+    for (;;) {
+      qint64 count = file.read(buffer.data(), READ_BLOCK);
+      if (count < 0) {
+        return QByteArray();
+      } else if (count == 0) {
+        break;
+      }
+      digest->add(buffer.data(), count);
+      offset += count;
+    }
+  }
+
+  *bytesRead = offset;
+  return digest->result();
+}
+
+QByteArray FileHasher::hash(const QString &filePath, Algorithm algorithm)
+{
+  return hashFiles(QStringList(filePath), algorithm).value(filePath);
+}
+
+QHash<QString, QByteArray> FileHasher::hashFiles(const QStringList &filePaths, Algorithm algorithm)
+{
+  struct Pending {
+    QString filePath;
+    QString key;
+    qint64 size;
+    qint64 modified;
+    QByteArray digest;
+    qint64 bytesRead;
+  };
+
+  QHash<QString, QByteArray> result;
+  std::vector<Pending> candidates;
+  std::vector<Pending> pending;
+
+  // stat the files without holding the lock, this may take a while for large batches
+  foreach (const QString &filePath, filePaths) {
+    if (result.contains(filePath)) {
+      continue;
+    }
+    QFileInfo info(filePath);
+    if (!info.isFile()) {
+      continue;
+    }
+    candidates.push_back({ filePath, cacheKey(filePath, algorithm), info.size(),
+                           info.lastModified().toMSecsSinceEpoch(), QByteArray(), 0 });
+    // placeholder so duplicates in the input are only looked at once
+    result.insert(filePath, QByteArray());
+  }
+
+  {
+    QMutexLocker locker(&m_Mutex);
+    for (Pending &candidate : candidates) {
+      auto iter = m_Cache.find(candidate.key);
+      if ((iter != m_Cache.end()) && (iter->size == candidate.size) && (iter->modified == candidate.modified)) {
+        result.insert(candidate.filePath, iter->digest);
+        ++m_Statistics.cacheHits;
+      } else {
+        pending.push_back(std::move(candidate));
+      }
+    }
+  }
+
+  auto work = [algorithm] (Pending &item) {
+    item.digest = hashFile(item.filePath, algorithm, &item.bytesRead);
+  };
+
+  if ((pending.size() <= 1) || (m_MaxThreads <= 1)) {
+    for (Pending &item : pending) {
+      work(item);
+    }
+  } else {
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_MaxThreads);
+    for (Pending &item : pending) {
+      pool.start(new HashJob([&work, &item] () { work(item); }));
+    }
+    pool.waitForDone();
+  }
+
+  QMutexLocker locker(&m_Mutex);
+  for (const Pending &item : pending) {
+    if (item.digest.isEmpty()) {
+      result.remove(item.filePath);
+      continue;
+    }
+    result[item.filePath] = item.digest;
+    m_Cache.insert(item.key, { item.size, item.modified, item.digest });
+    m_CacheDirty = true;
+    ++m_Statistics.filesHashed;
+    m_Statistics.bytesHashed += item.bytesRead;
+  }
+
+  return result;
+}
+
+void FileHasher::loadCache()
+{
+  if (m_CacheFile.isEmpty()) {
+    return;
+  }
+  QFile file(m_CacheFile);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return;
+  }
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_0);
+  quint32 magic = 0;
+  quint16 version = 0;
+  quint32 count = 0;
+  stream >> magic >> version >> count;
+  if ((magic != CACHE_MAGIC) || (version != CACHE_VERSION)) {
+    qWarning("ignoring hash cache %s of unknown format", qPrintable(m_CacheFile));
+    return;
+  }
+
+  QHash<QString, CacheEntry> cache;
+  cache.reserve(static_cast<int>(std::min<quint32>(count, 1000000)));
+  for (quint32 i = 0; (i < count) && (stream.status() == QDataStream::Ok); ++i) {
+    QString key;
+    CacheEntry entry;
+    stream >> key >> entry.size >> entry.modified >> entry.digest;
+    cache.insert(key, entry);
+  }
+
+  if (stream.status() != QDataStream::Ok) {
+    qWarning("hash cache %s is damaged", qPrintable(m_CacheFile));
+    return;
+  }
+
+  QMutexLocker locker(&m_Mutex);
+  m_Cache.swap(cache);
+}
+
+bool FileHasher::saveCache()
+{
+  QMutexLocker locker(&m_Mutex);
+  if (m_CacheFile.isEmpty() || !m_CacheDirty) {
+    return true;
+  }
+
+  QDir().mkpath(QFileInfo(m_CacheFile).absolutePath());
+  // write to a temporary file first so a crash can't leave a truncated cache behind
+  QSaveFile file(m_CacheFile);
+  if (!file.open(QIODevice::WriteOnly)) {
+    qWarning("failed to write hash cache %s: %s", qPrintable(m_CacheFile), qPrintable(file.errorString()));
+    return false;
+  }
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream << CACHE_MAGIC << CACHE_VERSION << static_cast<quint32>(m_Cache.size());
+  for (auto iter = m_Cache.begin(); iter != m_Cache.end(); ++iter) {
+    stream << iter.key() << iter->size << iter->modified << iter->digest;
+  }
+
+  if ((stream.status() != QDataStream::Ok) || !file.commit()) {
+    qWarning("failed to write hash cache %s: %s", qPrintable(m_CacheFile), qPrintable(file.errorString()));
+    return false;
+  }
+  m_CacheDirty = false;
+  return true;
+}
+
+FileHasher::Statistics FileHasher::statistics() const
+{
+  QMutexLocker locker(&m_Mutex);
+  return m_Statistics;
+}
+
+} // namespace MOBase
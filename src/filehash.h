@@ -0,0 +1,140 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef FILEHASH_H
+#define FILEHASH_H
+
+
+#include "dllimport.h"
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+
+namespace MOBase {
+
+
+/**
+ * @brief computes content hashes of files and remembers them
+ *
+ * Hashes are cached per file and algorithm and validated against size and modification
+ * time of the file, so only files that changed are read again. The cache can be kept in
+ * a file to survive restarts.
+ */
+class QDLLEXPORT FileHasher
+{
+public:
+
+  enum Algorithm {
+    // 64-bit xxHash. By far the fastest, use this unless a specific hash is required
+    ALGORITHM_XXH64,
+    // CRC-32 as used by zip and 7z archives
+    ALGORITHM_CRC32,
+    ALGORITHM_MD5
+  };
+
+  struct Statistics {
+    int cacheHits;
+    int filesHashed;
+    qint64 bytesHashed;
+  };
+
+public:
+
+  /**
+   * @param cacheFile file to load the cache from and save it to. If this is empty,
+   *                  hashes are only cached in memory
+   * @param maxThreads maximum number of files hashed at the same time. 0 uses one thread per core
+   */
+  explicit FileHasher(const QString &cacheFile = QString(), int maxThreads = 0);
+
+  /**
+   * @brief saves the cache if it was changed
+   */
+  ~FileHasher();
+
+  /**
+   * @brief hash a file
+   * @param filePath path of the file
+   * @param algorithm the hash algorithm to use
+   * @return the digest (numeric hashes in big endian byte order) or an empty array if the
+   *         file couldn't be read
+   */
+  QByteArray hash(const QString &filePath, Algorithm algorithm);
+
+  /**
+   * @brief hash multiple files in parallel
+   * @param filePaths paths of the files
+   * @param algorithm the hash algorithm to use
+   * @return digests by file path. Files that couldn't be read are missing
+   */
+  QHash<QString, QByteArray> hashFiles(const QStringList &filePaths, Algorithm algorithm);
+
+  /**
+   * @brief hash a block of memory. This doesn't use the cache
+   */
+  static QByteArray hashData(const char *data, qint64 size, Algorithm algorithm);
+
+  /**
+   * @brief write the cache file now instead of waiting for destruction
+   * @return true on success or if there was nothing to write
+   */
+  bool saveCache();
+
+  /**
+   * @return number of files answered from the cache and hashed so far
+   */
+  Statistics statistics() const;
+
+private:
+
+  struct CacheEntry {
+    qint64 size;
+    qint64 modified;
+    QByteArray digest;
+  };
+
+private:
+
+  static QString cacheKey(const QString &filePath, Algorithm algorithm);
+
+  static QByteArray hashFile(const QString &filePath, Algorithm algorithm, qint64 *bytesRead);
+
+  void loadCache();
+
+private:
+
+  Q_DISABLE_COPY(FileHasher)
+
+  QString m_CacheFile;
+  int m_MaxThreads;
+
+  mutable QMutex m_Mutex;
+  QHash<QString, CacheEntry> m_Cache;
+  bool m_CacheDirty;
+  Statistics m_Statistics;
+
+};
+
+} // namespace MOBase
+
+#endif // FILEHASH_H
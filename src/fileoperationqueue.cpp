@@ -0,0 +1,637 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "fileoperationqueue.h"
+#include "filecopy.h"
+#include "fileremove.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSemaphore>
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include "utility.h"
+#include <QWidget>
+#include <objbase.h>
+#endif
+
+
+namespace MOBase {
+
+
+FileOperationJob::FileOperationJob(Type type, const QStringList &sources, const QStringList &destinations)
+  : m_Type(type)
+  , m_Sources(sources)
+  , m_Destinations(destinations)
+  , m_State(STATE_QUEUED)
+  , m_Progress(0)
+  , m_CancelRequested(false)
+{
+}
+
+FileOperationJob::State FileOperationJob::state() const
+{
+  return static_cast<State>(m_State.load());
+}
+
+bool FileOperationJob::isDone() const
+{
+  State current = state();
+  return (current != STATE_QUEUED) && (current != STATE_RUNNING);
+}
+
+int FileOperationJob::progress() const
+{
+  return m_Progress.load();
+}
+
+QString FileOperationJob::errorMessage() const
+{
+  QMutexLocker locker(&m_Mutex);
+  return m_ErrorMessage;
+}
+
+void FileOperationJob::cancel()
+{
+  m_CancelRequested = true;
+}
+
+bool FileOperationJob::isCancelRequested() const
+{
+  return m_CancelRequested.load();
+}
+
+bool FileOperationJob::waitForFinished(int timeout)
+{
+  QElapsedTimer timer;
+  timer.start();
+  QMutexLocker locker(&m_Mutex);
+  while (!isDone()) {
+    unsigned long remaining = ULONG_MAX;
+    if (timeout >= 0) {
+      // wake-ups may be spurious, only wait for what is left of the timeout
+      qint64 elapsed = timer.elapsed();
+      if (elapsed >= timeout) {
+        return false;
+      }
+      remaining = static_cast<unsigned long>(timeout - elapsed);
+    }
+    m_DoneCondition.wait(&m_Mutex, remaining);
+  }
+  return true;
+}
+
+void FileOperationJob::setProgress(qint64 done, qint64 total)
+{
+  int percent = total > 0 ? static_cast<int>(done * 100 / total) : 100;
+  // the total may grow while the operation runs, progress is never reported to go back.
+  // Only actual changes are signaled, backends may call this for every file
+  int previous = m_Progress.load();
+  while (percent > previous) {
+    if (m_Progress.compare_exchange_weak(previous, percent)) {
+      emit progressChanged(percent);
+      break;
+    }
+  }
+}
+
+void FileOperationJob::start()
+{
+  m_State = STATE_RUNNING;
+}
+
+void FileOperationJob::finish(bool success, const QString &errorMessage)
+{
+  if (success) {
+    setProgress(1, 1);
+  }
+  {
+    QMutexLocker locker(&m_Mutex);
+    m_ErrorMessage = errorMessage;
+    m_State = success ? STATE_SUCCEEDED
+                      : (isCancelRequested() ? STATE_CANCELLED : STATE_FAILED);
+    m_DoneCondition.wakeAll();
+  }
+  emit finished(success);
+}
+
+
+namespace {
+
+/**
+ * carries out operations with Qt and the functions from filecopy.h and fileremove.h
+ */
+class PortableBackend : public FileOperationBackend
+{
+public:
+
+  virtual bool execute(FileOperationJob &job, QString &errorMessage) override
+  {
+    switch (job.type()) {
+      case FileOperationJob::TYPE_COPY:
+      case FileOperationJob::TYPE_MOVE: {
+        return transfer(job, errorMessage);
+      } break;
+      case FileOperationJob::TYPE_RENAME: {
+        return rename(job, errorMessage);
+      } break;
+      case FileOperationJob::TYPE_DELETE:
+      case FileOperationJob::TYPE_RECYCLE: {
+        return remove(job, errorMessage);
+      } break;
+      default: {
+        errorMessage = QObject::tr("unsupported operation");
+        return false;
+      } break;
+    }
+  }
+
+private:
+
+  struct Step {
+    enum Kind {
+      MAKE_DIR,
+      TRANSFER_FILE,
+      // a symlink to a directory, moved as the link itself
+      MOVE_LINK,
+      // a directory moved with a single rename if possible, otherwise file by file
+      MOVE_DIR,
+      REMOVE_DIR
+    };
+
+    Kind kind;
+    QString source;
+    QString destination;
+  };
+
+private:
+
+  static bool isDirectory(const QFileInfo &info)
+  {
+    return info.isDir() && !info.isSymLink();
+  }
+
+  static bool cancelled(const FileOperationJob &job, QString &errorMessage)
+  {
+    if (job.isCancelRequested()) {
+      errorMessage = QObject::tr("cancelled");
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * pair sources with destinations the way SHFileOperation does it: either one
+   * destination per source or a single target directory
+   */
+  static bool resolveDestinations(const FileOperationJob &job, QList<QPair<QString, QString>> &pairs,
+                                  QString &errorMessage)
+  {
+    const QStringList &sources = job.sources();
+    const QStringList &destinations = job.destinations();
+    if ((destinations.size() != sources.size()) && (destinations.size() != 1)) {
+      errorMessage = QObject::tr("invalid number of destinations");
+      return false;
+    }
+    for (int i = 0; i < sources.size(); ++i) {
+      QString destination = destinations.size() == sources.size() ? destinations.at(i)
+                                                                  : destinations.at(0);
+      if ((destinations.size() != sources.size()) || isDirectory(QFileInfo(destination))) {
+        destination += "/" + QFileInfo(sources.at(i)).fileName();
+      }
+      pairs.append(qMakePair(sources.at(i), destination));
+    }
+    return true;
+  }
+
+  /**
+   * add the steps transferring the content of a directory one by one
+   */
+  static void appendTreeSteps(const QString &sourceBase, const QString &destinationBase, bool move,
+                              std::vector<Step> &steps)
+  {
+    steps.push_back({ Step::MAKE_DIR, sourceBase, destinationBase });
+    QDirIterator iter(sourceBase, QDir::Files | QDir::AllDirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+                      QDirIterator::Subdirectories);
+    while (iter.hasNext()) {
+      iter.next();
+      QFileInfo info = iter.fileInfo();
+      QString destination = destinationBase + iter.filePath().mid(sourceBase.length());
+      if (isDirectory(info)) {
+        steps.push_back({ Step::MAKE_DIR, info.filePath(), destination });
+      } else if (!info.isDir()) {
+        steps.push_back({ Step::TRANSFER_FILE, info.filePath(), destination });
+      } else if (move) {
+        // the link has to leave the directory before it gets removed. Copies leave out
+        // directory links like copyDirParallel does, to avoid endless recursion
+        steps.push_back({ Step::MOVE_LINK, info.filePath(), destination });
+      }
+    }
+    if (move) {
+      steps.push_back({ Step::REMOVE_DIR, sourceBase, QString() });
+    }
+  }
+
+  static bool transfer(FileOperationJob &job, QString &errorMessage)
+  {
+    bool move = job.type() == FileOperationJob::TYPE_MOVE;
+
+    QList<QPair<QString, QString>> pairs;
+    if (!resolveDestinations(job, pairs, errorMessage)) {
+      return false;
+    }
+
+    // work out all steps first so progress can be reported accurately. Only directories
+    // to be moved are expanded later, if they can't simply be renamed
+    std::vector<Step> steps;
+    for (const QPair<QString, QString> &pair : pairs) {
+      if (cancelled(job, errorMessage)) {
+        return false;
+      }
+      QFileInfo sourceInfo(pair.first);
+      if (!sourceInfo.exists() && !sourceInfo.isSymLink()) {
+        errorMessage = QObject::tr("\"%1\" doesn't exist").arg(pair.first);
+        return false;
+      }
+      if (!isDirectory(sourceInfo)) {
+        steps.push_back({ Step::TRANSFER_FILE, pair.first, pair.second });
+      } else if (move) {
+        steps.push_back({ Step::MOVE_DIR, sourceInfo.absoluteFilePath(), pair.second });
+      } else {
+        appendTreeSteps(sourceInfo.absoluteFilePath(), pair.second, move, steps);
+      }
+    }
+
+    for (size_t i = 0; i < steps.size(); ++i) {
+      if (cancelled(job, errorMessage)) {
+        return false;
+      }
+      // a copy since steps may be added below
+      const Step step = steps[i];
+      switch (step.kind) {
+        case Step::MAKE_DIR: {
+          if (!QDir().mkpath(step.destination)) {
+            errorMessage = QObject::tr("failed to create directory \"%1\"").arg(step.destination);
+            return false;
+          }
+        } break;
+        case Step::TRANSFER_FILE: {
+          QString fileError;
+          bool success = move ? moveFileFast(step.source, step.destination, &fileError)
+                              : copyFileFast(step.source, step.destination, &fileError);
+          if (!success) {
+            errorMessage = QObject::tr("failed to %1 \"%2\" to \"%3\": %4")
+                             .arg(move ? QObject::tr("move") : QObject::tr("copy"))
+                             .arg(step.source).arg(step.destination).arg(fileError);
+            return false;
+          }
+        } break;
+        case Step::MOVE_LINK: {
+          if (!QDir().rename(step.source, step.destination)) {
+            errorMessage = QObject::tr("failed to move link \"%1\" to \"%2\"")
+                             .arg(step.source).arg(step.destination);
+            return false;
+          }
+        } break;
+        case Step::MOVE_DIR: {
+          // within a volume this is a single rename. Otherwise, or to merge with an
+          // existing directory, the content is moved file by file
+          if (QFileInfo(step.destination).exists() || !QDir().rename(step.source, step.destination)) {
+            std::vector<Step> treeSteps;
+            appendTreeSteps(step.source, step.destination, move, treeSteps);
+            steps.insert(steps.begin() + i + 1, treeSteps.begin(), treeSteps.end());
+          }
+        } break;
+        case Step::REMOVE_DIR: {
+          // all files were moved out at this point
+          RemoveReport report;
+          if (!removeDirParallel(step.source, &report)) {
+            errorMessage = QObject::tr("failed to remove \"%1\"").arg(step.source);
+            return false;
+          }
+        } break;
+      }
+      job.setProgress(i + 1, steps.size());
+    }
+    return true;
+  }
+
+  static bool rename(FileOperationJob &job, QString &errorMessage)
+  {
+    if ((job.sources().size() != 1) || (job.destinations().size() != 1)) {
+      errorMessage = QObject::tr("invalid number of files");
+      return false;
+    }
+    const QString &oldName = job.sources().at(0);
+    const QString &newName = job.destinations().at(0);
+    if (QFileInfo(newName).exists()) {
+      errorMessage = QObject::tr("\"%1\" already exists").arg(newName);
+      return false;
+    }
+    if (!QDir().rename(oldName, newName)) {
+      errorMessage = QObject::tr("failed to rename \"%1\" to \"%2\"").arg(oldName).arg(newName);
+      return false;
+    }
+    return true;
+  }
+
+  static bool remove(FileOperationJob &job, QString &errorMessage)
+  {
+    bool recycle = job.type() == FileOperationJob::TYPE_RECYCLE;
+#if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
+    if (recycle) {
+      errorMessage = QObject::tr("the recycle bin is not supported");
+      return false;
+    }
+#endif
+
+    const QStringList &fileNames = job.sources();
+    for (int i = 0; i < fileNames.size(); ++i) {
+      if (cancelled(job, errorMessage)) {
+        return false;
+      }
+      const QString &fileName = fileNames.at(i);
+      QFileInfo info(fileName);
+      bool success = false;
+      if (recycle) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        success = QFile::moveToTrash(fileName);
+#endif
+      } else if (isDirectory(info)) {
+        RemoveReport report;
+        success = removeDirParallel(fileName, &report);
+        if (!success && !report.errors.isEmpty()) {
+          errorMessage = QObject::tr("removal of \"%1\" failed: %2")
+                           .arg(report.errors.first().path).arg(report.errors.first().message);
+          return false;
+        }
+      } else {
+        QFile file(fileName);
+        success = file.remove();
+      }
+      if (!success) {
+        errorMessage = QObject::tr("removal of \"%1\" failed").arg(fileName);
+        return false;
+      }
+      job.setProgress(i + 1, fileNames.size());
+    }
+    return true;
+  }
+
+};
+
+
+#ifdef Q_OS_WIN
+
+/**
+ * runs a function on the thread of a ShellBackend and waits for it
+ */
+class ShellCall : public QRunnable
+{
+public:
+
+  ShellCall(const std::function<void()> &func, QSemaphore &done)
+    : m_Func(func), m_Done(done)
+  {}
+
+  virtual void run() override
+  {
+    // initialized once, the thread lives as long as the backend
+    static thread_local bool comInitialized = false;
+    if (!comInitialized) {
+      HRESULT result = ::CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+      if (FAILED(result)) {
+        qWarning("failed to initialize COM for shell file operations: %lx", result);
+      }
+      comInitialized = true;
+    }
+    m_Func();
+    m_Done.release();
+  }
+
+private:
+
+  std::function<void()> m_Func;
+  QSemaphore &m_Done;
+
+};
+
+/**
+ * carries out operations with SHFileOperation. All operations run one at a time on a single
+ * thread initialized for COM, so at most one conflict dialog is shown
+ */
+class ShellBackend : public FileOperationBackend
+{
+public:
+
+  explicit ShellBackend(QWidget *owner)
+    : m_Owner(owner)
+  {
+    if (m_Owner != nullptr) {
+      // create the native window here (on the gui thread) so the shell thread only reads it
+      m_Owner->winId();
+    }
+    m_Thread.setMaxThreadCount(1);
+    m_Thread.setExpiryTimeout(-1);
+  }
+
+  virtual bool execute(FileOperationJob &job, QString &errorMessage) override
+  {
+    QSemaphore done;
+    bool success = false;
+    DWORD error = ERROR_SUCCESS;
+    m_Thread.start(new ShellCall([&]() {
+      success = executeShell(job);
+      error = success ? ERROR_SUCCESS : ::GetLastError();
+    }, done));
+    done.acquire();
+    if (!success) {
+      errorMessage = windowsErrorString(error);
+    }
+    return success;
+  }
+
+private:
+
+  bool executeShell(FileOperationJob &job)
+  {
+    bool success = false;
+    switch (job.type()) {
+      case FileOperationJob::TYPE_COPY: {
+        success = shellCopy(job.sources(), job.destinations(), m_Owner);
+      } break;
+      case FileOperationJob::TYPE_MOVE: {
+        success = shellMove(job.sources(), job.destinations(), m_Owner);
+      } break;
+      case FileOperationJob::TYPE_RENAME: {
+        success = (job.sources().size() == 1) && (job.destinations().size() == 1)
+               && shellRename(job.sources().at(0), job.destinations().at(0), false, m_Owner);
+      } break;
+      case FileOperationJob::TYPE_DELETE:
+      case FileOperationJob::TYPE_RECYCLE: {
+        success = shellDelete(job.sources(), job.type() == FileOperationJob::TYPE_RECYCLE, m_Owner);
+      } break;
+    }
+    return success;
+  }
+
+private:
+
+  QWidget *m_Owner;
+  QThreadPool m_Thread;
+
+};
+
+#endif // Q_OS_WIN
+
+
+/**
+ * runs a single job on the pool of the queue
+ */
+class FileOperationRunner : public QRunnable
+{
+public:
+
+  FileOperationRunner(const FileOperationHandle &job, const std::shared_ptr<FileOperationBackend> &backend)
+    : m_Job(job), m_Backend(backend)
+  {}
+
+  virtual void run() override
+  {
+    if (m_Job->isCancelRequested()) {
+      m_Job->finish(false, QObject::tr("cancelled"));
+      return;
+    }
+    m_Job->start();
+    QString errorMessage;
+    bool success = m_Backend->execute(*m_Job, errorMessage);
+    m_Job->finish(success, errorMessage);
+  }
+
+private:
+
+  FileOperationHandle m_Job;
+  std::shared_ptr<FileOperationBackend> m_Backend;
+
+};
+
+}
+
+
+std::shared_ptr<FileOperationBackend> FileOperationBackend::createPortable()
+{
+  return std::make_shared<PortableBackend>();
+}
+
+#ifdef Q_OS_WIN
+std::shared_ptr<FileOperationBackend> FileOperationBackend::createShell(QWidget *owner)
+{
+  return std::make_shared<ShellBackend>(owner);
+}
+#endif
+
+
+FileOperationQueue::FileOperationQueue(const std::shared_ptr<FileOperationBackend> &backend, int maxThreads)
+  : m_Backend(backend)
+{
+  if (m_Backend.get() == nullptr) {
+    m_Backend = FileOperationBackend::createPortable();
+  }
+  m_Pool.setMaxThreadCount(std::max(maxThreads, 1));
+}
+
+FileOperationQueue::~FileOperationQueue()
+{
+  waitForDone();
+}
+
+FileOperationQueue &FileOperationQueue::instance()
+{
+  static FileOperationQueue s_Instance;
+  return s_Instance;
+}
+
+FileOperationHandle FileOperationQueue::copy(const QStringList &sourceNames, const QStringList &destinationNames)
+{
+  return enqueue(FileOperationJob::TYPE_COPY, sourceNames, destinationNames);
+}
+
+FileOperationHandle FileOperationQueue::move(const QStringList &sourceNames, const QStringList &destinationNames)
+{
+  return enqueue(FileOperationJob::TYPE_MOVE, sourceNames, destinationNames);
+}
+
+FileOperationHandle FileOperationQueue::rename(const QString &oldName, const QString &newName)
+{
+  return enqueue(FileOperationJob::TYPE_RENAME, QStringList(oldName), QStringList(newName));
+}
+
+FileOperationHandle FileOperationQueue::remove(const QStringList &fileNames, bool recycle)
+{
+  return enqueue(recycle ? FileOperationJob::TYPE_RECYCLE : FileOperationJob::TYPE_DELETE,
+                 fileNames, QStringList());
+}
+
+void FileOperationQueue::cancelAll()
+{
+  QMutexLocker locker(&m_JobsMutex);
+  for (const QWeakPointer<FileOperationJob> &job : m_Jobs) {
+    FileOperationHandle handle = job.toStrongRef();
+    if (!handle.isNull()) {
+      handle->cancel();
+    }
+  }
+}
+
+void FileOperationQueue::waitForDone()
+{
+  m_Pool.waitForDone();
+}
+
+FileOperationHandle FileOperationQueue::enqueue(FileOperationJob::Type type, const QStringList &sources,
+                                                const QStringList &destinations)
+{
+  // the last reference may be dropped by the worker thread while signals are still queued
+  FileOperationHandle job(new FileOperationJob(type, sources, destinations), &QObject::deleteLater);
+  {
+    QMutexLocker locker(&m_JobsMutex);
+    // forget about jobs nobody references any more
+    for (auto iter = m_Jobs.begin(); iter != m_Jobs.end();) {
+      if (iter->isNull()) {
+        iter = m_Jobs.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+    m_Jobs.append(job.toWeakRef());
+  }
+  m_Pool.start(new FileOperationRunner(job, m_Backend));
+  return job;
+}
+
+} // namespace MOBase
@@ -0,0 +1,261 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef FILEOPERATIONQUEUE_H
+#define FILEOPERATIONQUEUE_H
+
+
+#include "dllimport.h"
+#include <QObject>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <atomic>
+#include <memory>
+
+
+class QWidget;
+
+namespace MOBase {
+
+
+/**
+ * @brief a file operation that is queued or running in the background. All functions
+ *        can be called from any thread. Signals are emitted from the thread running the
+ *        operation, so connections to objects in the gui thread are queued
+ */
+class QDLLEXPORT FileOperationJob : public QObject
+{
+
+  Q_OBJECT
+
+public:
+
+  enum Type {
+    TYPE_COPY,
+    TYPE_MOVE,
+    TYPE_RENAME,
+    TYPE_DELETE,
+    TYPE_RECYCLE
+  };
+
+  enum State {
+    STATE_QUEUED,
+    STATE_RUNNING,
+    STATE_SUCCEEDED,
+    STATE_FAILED,
+    STATE_CANCELLED
+  };
+
+public:
+
+  FileOperationJob(Type type, const QStringList &sources, const QStringList &destinations);
+
+  Type type() const { return m_Type; }
+  const QStringList &sources() const { return m_Sources; }
+  const QStringList &destinations() const { return m_Destinations; }
+
+  State state() const;
+
+  /**
+   * @return true if the operation has ended, successful or not
+   */
+  bool isDone() const;
+
+  /**
+   * @return progress in percent. This never decreases
+   */
+  int progress() const;
+
+  /**
+   * @return description of the problem if the operation failed
+   */
+  QString errorMessage() const;
+
+  /**
+   * @brief request the operation to stop. Queued operations don't start at all, running
+   *        operations stop at the next file. Files already processed stay processed
+   */
+  void cancel();
+
+  /**
+   * @return true if cancel was called. Backends should check this between files
+   */
+  bool isCancelRequested() const;
+
+  /**
+   * @brief block until the operation has ended
+   * @param timeout maximum time to wait in milliseconds. -1 waits indefinitely
+   * @return true if the operation has ended
+   */
+  bool waitForFinished(int timeout = -1);
+
+  /**
+   * @brief update progress. Called by the backend
+   */
+  void setProgress(qint64 done, qint64 total);
+
+  /**
+   * @brief called by the queue when the operation starts
+   */
+  void start();
+
+  /**
+   * @brief called by the queue when the operation has ended
+   * @param success true if the operation succeeded
+   * @param errorMessage description of the problem if it failed
+   */
+  void finish(bool success, const QString &errorMessage = QString());
+
+signals:
+
+  void progressChanged(int percent);
+
+  /**
+   * @brief the operation ended. This may be emitted before the caller got to connect to
+   *        it, so check isDone() after connecting
+   */
+  void finished(bool success);
+
+private:
+
+  const Type m_Type;
+  const QStringList m_Sources;
+  const QStringList m_Destinations;
+
+  std::atomic<int> m_State;
+  std::atomic<int> m_Progress;
+  std::atomic<bool> m_CancelRequested;
+
+  mutable QMutex m_Mutex;
+  QWaitCondition m_DoneCondition;
+  QString m_ErrorMessage;
+
+};
+
+typedef QSharedPointer<FileOperationJob> FileOperationHandle;
+
+
+/**
+ * @brief carries out file operations for FileOperationQueue
+ */
+class QDLLEXPORT FileOperationBackend
+{
+public:
+
+  virtual ~FileOperationBackend() {}
+
+  /**
+   * @brief carry out the operation described by job. This is called on a worker thread
+   * @param job the operation. Use it to report progress and check for cancellation
+   * @param errorMessage receives a description of the problem on error
+   * @return true on success
+   */
+  virtual bool execute(FileOperationJob &job, QString &errorMessage) = 0;
+
+  /**
+   * @return a backend that works on all platforms. Copies and moves don't overwrite existing files
+   */
+  static std::shared_ptr<FileOperationBackend> createPortable();
+
+#ifdef Q_OS_WIN
+  /**
+   * @brief create a backend using SHFileOperation (shellCopy and friends). It asks the user on
+   *        conflicts like the synchronous functions do but can't be cancelled once started
+   *        and doesn't report intermediate progress. Operations run one at a time on a thread
+   *        of the backend initialized for COM. Has to be called on the gui thread
+   * @param owner window owning the dialogs of the shell. Must outlive the backend
+   */
+  static std::shared_ptr<FileOperationBackend> createShell(QWidget *owner = nullptr);
+#endif
+
+};
+
+
+/**
+ * @brief runs file operations in the background so the calling thread (usually the gui)
+ *        isn't blocked. These are the asynchronous counterparts of shellCopy, shellMove,
+ *        shellRename and shellDelete
+ *
+ * Operations start right away, a short one may have ended by the time the handle is
+ * returned. The job objects live on the thread that queued them and are deleted through
+ * its event loop once no handle references them any more
+ */
+class QDLLEXPORT FileOperationQueue
+{
+public:
+
+  /**
+   * @param backend the backend carrying out operations. If this is null, the portable backend
+   *                is used, which supports progress and cancellation
+   * @param maxThreads number of operations that may run at the same time. Operations on
+   *                   the same disk usually don't benefit from running concurrently
+   */
+  explicit FileOperationQueue(const std::shared_ptr<FileOperationBackend> &backend = nullptr, int maxThreads = 2);
+
+  /**
+   * @brief waits for all operations to end
+   */
+  ~FileOperationQueue();
+
+  /**
+   * @return the queue shared by the application
+   */
+  static FileOperationQueue &instance();
+
+  FileOperationHandle copy(const QStringList &sourceNames, const QStringList &destinationNames);
+
+  FileOperationHandle move(const QStringList &sourceNames, const QStringList &destinationNames);
+
+  FileOperationHandle rename(const QString &oldName, const QString &newName);
+
+  FileOperationHandle remove(const QStringList &fileNames, bool recycle = false);
+
+  /**
+   * @brief cancel all operations that are queued or running
+   */
+  void cancelAll();
+
+  /**
+   * @brief block until all operations have ended
+   */
+  void waitForDone();
+
+private:
+
+  FileOperationHandle enqueue(FileOperationJob::Type type, const QStringList &sources,
+                              const QStringList &destinations);
+
+private:
+
+  Q_DISABLE_COPY(FileOperationQueue)
+
+  std::shared_ptr<FileOperationBackend> m_Backend;
+  QThreadPool m_Pool;
+  QMutex m_JobsMutex;
+  QList<QWeakPointer<FileOperationJob>> m_Jobs;
+
+};
+
+} // namespace MOBase
+
+#endif // FILEOPERATIONQUEUE_H
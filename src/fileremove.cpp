@@ -0,0 +1,407 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "fileremove.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QObject>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <atomic>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include "utility.h"
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace MOBase {
+
+
+namespace {
+
+/**
+ * shared state of a parallel remove
+ */
+struct RemoveState {
+  RemoveState() : filesRemoved(0), directoriesRemoved(0), rootRemoved(false), pool(nullptr) {}
+
+  void addError(const QString &path, const QString &message)
+  {
+    QMutexLocker locker(&errorMutex);
+    errors.append({ path, message });
+  }
+
+  std::atomic<int> filesRemoved;
+  std::atomic<int> directoriesRemoved;
+  std::atomic<bool> rootRemoved;
+  QThreadPool *pool;
+  QMutex errorMutex;
+  QList<FileRemoveError> errors;
+};
+
+/**
+ * a directory being removed. The directory itself is removed by whichever thread
+ * finishes the last piece of work inside it
+ */
+struct DirectoryNode {
+  DirectoryNode(DirectoryNode *parent, const QString &path)
+    : parent(parent), path(path), depth(parent != nullptr ? parent->depth + 1 : 0)
+    , pending(1), failed(false)
+  {}
+
+  DirectoryNode *parent;
+  QString path;
+  int depth;
+  // 1 for the enumeration of this directory plus one per sub-directory job
+  std::atomic<int> pending;
+  std::atomic<bool> failed;
+};
+
+void spawn(DirectoryNode *parent, const QString &path, RemoveState &state);
+
+
+#ifdef Q_OS_WIN
+
+bool removeEmptyDirectory(const QString &path, QString *errorMessage)
+{
+  std::wstring nativePath = ToWString(QDir::toNativeSeparators(path));
+  ::SetFileAttributesW(nativePath.c_str(), FILE_ATTRIBUTE_NORMAL);
+  if (!::RemoveDirectoryW(nativePath.c_str())) {
+    *errorMessage = windowsErrorString(::GetLastError());
+    return false;
+  }
+  return true;
+}
+
+void removeContent(DirectoryNode *node, RemoveState &state)
+{
+  WIN32_FIND_DATAW findData;
+  std::wstring pattern = ToWString(QDir::toNativeSeparators(node->path) + "\\*");
+  HANDLE search = ::FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &findData,
+                                     FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+  if (search == INVALID_HANDLE_VALUE) {
+    DWORD error = ::GetLastError();
+    if (error != ERROR_FILE_NOT_FOUND) {
+      state.addError(node->path, windowsErrorString(error));
+      node->failed = true;
+    }
+    return;
+  }
+
+  do {
+    QString name = QString::fromWCharArray(findData.cFileName);
+    if ((name == ".") || (name == "..")) {
+      continue;
+    }
+    QString path = node->path + "/" + name;
+    bool isDirectory = (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    if (isDirectory && ((findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0)) {
+      spawn(node, path, state);
+      continue;
+    }
+
+    // junctions and directory symlinks are removed like files, their target is left alone
+    std::wstring nativePath = ToWString(QDir::toNativeSeparators(path));
+    ::SetFileAttributesW(nativePath.c_str(), FILE_ATTRIBUTE_NORMAL);
+    BOOL removed = isDirectory ? ::RemoveDirectoryW(nativePath.c_str())
+                               : ::DeleteFileW(nativePath.c_str());
+    if (removed) {
+      ++state.filesRemoved;
+    } else {
+      state.addError(path, windowsErrorString(::GetLastError()));
+      node->failed = true;
+    }
+  } while (::FindNextFileW(search, &findData));
+
+  ::FindClose(search);
+}
+
+#else // Q_OS_WIN
+
+// directories up to this depth get a job of their own, everything below is removed
+// by the job of its ancestor relative to open directory descriptors
+const int ParallelDepth = 3;
+
+QString errnoString()
+{
+  return QString::fromLocal8Bit(strerror(errno));
+}
+
+bool isDirectory(int dirFd, const struct dirent *entry)
+{
+  if (entry->d_type == DT_DIR) {
+    return true;
+  } else if (entry->d_type != DT_UNKNOWN) {
+    return false;
+  }
+  // the file system doesn't report types while enumerating
+  struct stat entryStat;
+  return (::fstatat(dirFd, entry->d_name, &entryStat, AT_SYMLINK_NOFOLLOW) == 0)
+      && S_ISDIR(entryStat.st_mode);
+}
+
+bool isDots(const char *name)
+{
+  return (name[0] == '.') && ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0')));
+}
+
+bool removeEmptyDirectory(const QString &path, QString *errorMessage)
+{
+  if (::rmdir(QFile::encodeName(path).constData()) != 0) {
+    *errorMessage = errnoString();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * remove the directory "name" inside parentFd with everything in it, without recursion
+ */
+bool removeTreeAt(int parentFd, const QByteArray &name, const QString &parentPath, RemoveState &state)
+{
+  struct Frame {
+    DIR *dir;
+    QByteArray name;
+    bool failed;
+  };
+  std::vector<Frame> stack;
+
+  // full paths are only needed for error messages
+  auto pathOf = [&] (const QByteArray &entryName) -> QString {
+    QString result = parentPath;
+    for (const Frame &frame : stack) {
+      result += "/" + QFile::decodeName(frame.name);
+    }
+    return result + "/" + QFile::decodeName(entryName);
+  };
+
+  auto openFrame = [&] (int fd, const QByteArray &entryName) -> bool {
+    int dirFd = ::openat(fd, entryName.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dir = dirFd >= 0 ? ::fdopendir(dirFd) : nullptr;
+    if (dir == nullptr) {
+      QString message = errnoString();
+      state.addError(pathOf(entryName), message);
+      if (dirFd >= 0) {
+        ::close(dirFd);
+      }
+      return false;
+    }
+    stack.push_back({ dir, entryName, false });
+    return true;
+  };
+
+  if (!openFrame(parentFd, name)) {
+    return false;
+  }
+
+  bool success = true;
+  while (!stack.empty()) {
+    Frame &top = stack.back();
+    int topFd = ::dirfd(top.dir);
+    struct dirent *entry = ::readdir(top.dir);
+    if (entry == nullptr) {
+      // directory is empty (unless something failed), remove it from its parent
+      Frame done = top;
+      ::closedir(done.dir);
+      stack.pop_back();
+      int fd = stack.empty() ? parentFd : ::dirfd(stack.back().dir);
+      bool failed = done.failed;
+      if (!failed) {
+        if (::unlinkat(fd, done.name.constData(), AT_REMOVEDIR) == 0) {
+          ++state.directoriesRemoved;
+        } else {
+          QString message = errnoString();
+          state.addError(pathOf(done.name), message);
+          failed = true;
+        }
+      }
+      if (failed) {
+        if (stack.empty()) {
+          success = false;
+        } else {
+          stack.back().failed = true;
+        }
+      }
+      continue;
+    }
+
+    if (isDots(entry->d_name)) {
+      continue;
+    }
+
+    if (isDirectory(topFd, entry)) {
+      if (!openFrame(topFd, QByteArray(entry->d_name))) {
+        top.failed = true;
+      }
+    } else if (::unlinkat(topFd, entry->d_name, 0) == 0) {
+      ++state.filesRemoved;
+    } else {
+      QString message = errnoString();
+      state.addError(pathOf(QByteArray(entry->d_name)), message);
+      top.failed = true;
+    }
+  }
+  return success;
+}
+
+void removeContent(DirectoryNode *node, RemoveState &state)
+{
+  // the directory named by the caller may be a symlink, below that nothing is followed
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (node->parent != nullptr ? O_NOFOLLOW : 0);
+  int fd = ::open(QFile::encodeName(node->path).constData(), flags);
+  DIR *dir = fd >= 0 ? ::fdopendir(fd) : nullptr;
+  if (dir == nullptr) {
+    QString message = errnoString();
+    state.addError(node->path, message);
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    node->failed = true;
+    return;
+  }
+
+  while (struct dirent *entry = ::readdir(dir)) {
+    if (isDots(entry->d_name)) {
+      continue;
+    }
+    if (isDirectory(fd, entry)) {
+      if (node->depth < ParallelDepth) {
+        spawn(node, node->path + "/" + QFile::decodeName(entry->d_name), state);
+      } else if (!removeTreeAt(fd, QByteArray(entry->d_name), node->path, state)) {
+        node->failed = true;
+      }
+    } else if (::unlinkat(fd, entry->d_name, 0) == 0) {
+      ++state.filesRemoved;
+    } else {
+      QString message = errnoString();
+      state.addError(node->path + "/" + QFile::decodeName(entry->d_name), message);
+      node->failed = true;
+    }
+  }
+
+  ::closedir(dir);
+}
+
+#endif // Q_OS_WIN
+
+
+/**
+ * called when a piece of work inside node is done. Removes the directory once
+ * everything inside it is done and continues upwards
+ */
+void finish(DirectoryNode *node, RemoveState &state)
+{
+  while ((node != nullptr) && (--node->pending == 0)) {
+    if (!node->failed) {
+      QString errorMessage;
+      if (removeEmptyDirectory(node->path, &errorMessage)) {
+        ++state.directoriesRemoved;
+      } else {
+        state.addError(node->path, errorMessage);
+        node->failed = true;
+      }
+    }
+
+    DirectoryNode *parent = node->parent;
+    if (parent == nullptr) {
+      state.rootRemoved = !node->failed;
+    } else if (node->failed) {
+      // don't try to remove directories we know aren't empty
+      parent->failed = true;
+    }
+    delete node;
+    node = parent;
+  }
+}
+
+
+class RemoveJob : public QRunnable {
+public:
+  RemoveJob(DirectoryNode *node, RemoveState &state)
+    : m_Node(node), m_State(state)
+  {}
+
+  virtual void run()
+  {
+    removeContent(m_Node, m_State);
+    finish(m_Node, m_State);
+  }
+
+private:
+  DirectoryNode *m_Node;
+  RemoveState &m_State;
+};
+
+
+void spawn(DirectoryNode *parent, const QString &path, RemoveState &state)
+{
+  ++parent->pending;
+  state.pool->start(new RemoveJob(new DirectoryNode(parent, path), state));
+}
+
+}
+
+
+bool removeDirParallel(const QString &dirName, RemoveReport *report, int maxThreads)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  RemoveState state;
+  if (!QFileInfo(dirName).isDir()) {
+    state.addError(dirName, QObject::tr("directory doesn't exist"));
+  } else {
+    if (maxThreads <= 0) {
+      maxThreads = QThread::idealThreadCount();
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(maxThreads);
+    state.pool = &pool;
+    pool.start(new RemoveJob(new DirectoryNode(nullptr, QDir::cleanPath(dirName)), state));
+    pool.waitForDone();
+  }
+
+  if (report != nullptr) {
+    report->filesRemoved = state.filesRemoved.load();
+    report->directoriesRemoved = state.directoriesRemoved.load();
+    report->elapsedMs = timer.elapsed();
+    report->errors = state.errors;
+  }
+
+  return state.rootRemoved.load();
+}
+
+} // namespace MOBase
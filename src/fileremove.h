@@ -0,0 +1,69 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef FILEREMOVE_H
+#define FILEREMOVE_H
+
+
+#include "dllimport.h"
+#include <QString>
+#include <QList>
+
+
+namespace MOBase {
+
+
+/**
+ * @brief a file or directory that couldn't be removed
+ */
+struct FileRemoveError {
+  QString path;
+  QString message;
+};
+
+
+/**
+ * @brief summary of a remove operation
+ */
+struct RemoveReport {
+  RemoveReport() : filesRemoved(0), directoriesRemoved(0), elapsedMs(0) {}
+
+  int filesRemoved;
+  int directoriesRemoved;
+  qint64 elapsedMs;
+  QList<FileRemoveError> errors;
+};
+
+
+/**
+ * @brief remove a directory including all its content, removing independent
+ *        sub-directories on multiple threads
+ * @param dirName name of the directory to remove
+ * @param report (optional) receives statistics and a list of everything that couldn't be removed
+ * @param maxThreads maximum number of threads to use. 0 uses one thread per core
+ * @return true if the directory was removed completely
+ * @note removal doesn't stop at the first error, everything that can be removed is removed.
+ *       symbolic links and junctions are removed but not followed
+ */
+QDLLEXPORT bool removeDirParallel(const QString &dirName, RemoveReport *report = nullptr, int maxThreads = 0);
+
+} // namespace MOBase
+
+#endif // FILEREMOVE_H
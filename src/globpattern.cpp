@@ -0,0 +1,624 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "globpattern.h"
+#include <QChar>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define GLOB_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace MOBase {
+
+
+namespace {
+
+inline bool isSeparator(ushort ch)
+{
+  return (ch == '/') || (ch == '\\');
+}
+
+inline ushort foldCase(ushort ch)
+{
+  if (ch < 0x80) {
+    return ((ch >= 'A') && (ch <= 'Z')) ? ch + ('a' - 'A') : ch;
+  }
+  return QChar(ch).toCaseFolded().unicode();
+}
+
+inline ushort upperCase(ushort ch)
+{
+  if (ch < 0x80) {
+    return ((ch >= 'a') && (ch <= 'z')) ? ch - ('a' - 'A') : ch;
+  }
+  return QChar(ch).toUpper().unicode();
+}
+
+inline int lowestBit(quint64 value)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+#ifdef _M_X64
+  _BitScanForward64(&index, value);
+#else
+  if (!_BitScanForward(&index, static_cast<unsigned long>(value))) {
+    _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+    index += 32;
+  }
+#endif
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+}
+
+
+GlobPattern::GlobPattern()
+  : m_CaseSensitive(false)
+  , m_FirstToken(0)
+  , m_LastToken(0)
+  , m_LeadingDirectories(false)
+{
+}
+
+GlobPattern::GlobPattern(const QString &pattern, Qt::CaseSensitivity caseSensitivity)
+  : m_Pattern(pattern)
+  , m_CaseSensitive(caseSensitivity == Qt::CaseSensitive)
+  , m_FirstToken(0)
+  , m_LastToken(0)
+  , m_LeadingDirectories(false)
+{
+  compile();
+}
+
+void GlobPattern::compile()
+{
+  const int length = m_Pattern.size();
+  for (int i = 0; i < length; ++i) {
+    ushort ch = m_Pattern.at(i).unicode();
+    if (ch == '*') {
+      if ((i + 1 < length) && (m_Pattern.at(i + 1) == '*')) {
+        while ((i + 1 < length) && (m_Pattern.at(i + 1) == '*')) {
+          ++i;
+        }
+        if ((i + 1 < length) && isSeparator(m_Pattern.at(i + 1).unicode())) {
+          ++i;
+          m_Tokens.push_back({ TOKEN_DIRECTORIES, 0 });
+        } else {
+          m_Tokens.push_back({ TOKEN_DOUBLESTAR, 0 });
+        }
+      } else {
+        m_Tokens.push_back({ TOKEN_STAR, 0 });
+      }
+    } else if (ch == '?') {
+      m_Tokens.push_back({ TOKEN_ANY, 0 });
+    } else if (isSeparator(ch)) {
+      m_Tokens.push_back({ TOKEN_SEPARATOR, '/' });
+    } else if (ch == '[') {
+      CharClass charClass;
+      int pos = i + 1;
+      charClass.negated = (pos < length) && ((m_Pattern.at(pos) == '!') || (m_Pattern.at(pos) == '^'));
+      if (charClass.negated) {
+        ++pos;
+      }
+      // a ] right at the start is part of the class
+      bool first = true;
+      while ((pos < length) && (first || (m_Pattern.at(pos) != ']'))) {
+        ushort rangeStart = m_Pattern.at(pos).unicode();
+        ushort rangeEnd = rangeStart;
+        if ((pos + 2 < length) && (m_Pattern.at(pos + 1) == '-') && (m_Pattern.at(pos + 2) != ']')) {
+          rangeEnd = m_Pattern.at(pos + 2).unicode();
+          pos += 2;
+        }
+        charClass.ranges.push_back(rangeStart);
+        charClass.ranges.push_back(rangeEnd);
+        ++pos;
+        first = false;
+      }
+      if (pos < length) {
+        m_Tokens.push_back({ TOKEN_CLASS, static_cast<ushort>(m_Classes.size()) });
+        m_Classes.push_back(charClass);
+        i = pos;
+      } else {
+        // not terminated, so it's just a bracket
+        m_Tokens.push_back({ TOKEN_CHAR, ch });
+      }
+    } else {
+      m_Tokens.push_back({ TOKEN_CHAR, m_CaseSensitive ? ch : foldCase(ch) });
+    }
+  }
+
+  auto isFixed = [] (const Token &token) {
+    return (token.type == TOKEN_CHAR) || (token.type == TOKEN_SEPARATOR);
+  };
+
+  const int count = static_cast<int>(m_Tokens.size());
+  m_FirstToken = 0;
+  while ((m_FirstToken < count) && isFixed(m_Tokens[m_FirstToken])) {
+    m_Prefix.append(QChar(m_Tokens[m_FirstToken].value));
+    ++m_FirstToken;
+  }
+  m_LastToken = count;
+  while ((m_LastToken > m_FirstToken) && isFixed(m_Tokens[m_LastToken - 1])) {
+    --m_LastToken;
+    m_Suffix.prepend(QChar(m_Tokens[m_LastToken].value));
+  }
+
+  // the simd search compares the first character with both cases, that only works
+  // reliably for ascii
+  QString run;
+  for (int i = m_FirstToken; i <= m_LastToken; ++i) {
+    if ((i < m_LastToken) && (m_Tokens[i].type == TOKEN_CHAR)
+        && (m_CaseSensitive || !run.isEmpty() || (m_Tokens[i].value < 0x80))) {
+      run.append(QChar(m_Tokens[i].value));
+    } else {
+      if (run.size() > m_Infix.size()) {
+        m_Infix = run;
+      }
+      run.clear();
+    }
+  }
+
+  int segmentStart = m_FirstToken;
+  if ((segmentStart < m_LastToken) && (m_Tokens[segmentStart].type == TOKEN_DIRECTORIES)) {
+    // "**/*.esp" and the like: if nothing after the "**/" can match a separator, only
+    // the last path component has to be looked at
+    m_LeadingDirectories = true;
+    for (int i = segmentStart + 1; i < m_LastToken; ++i) {
+      if ((m_Tokens[i].type == TOKEN_SEPARATOR) || (m_Tokens[i].type == TOKEN_DOUBLESTAR)
+          || (m_Tokens[i].type == TOKEN_DIRECTORIES)) {
+        m_LeadingDirectories = false;
+        break;
+      }
+    }
+    if (m_LeadingDirectories) {
+      ++segmentStart;
+    }
+  }
+  if (!compileSegments(segmentStart)) {
+    m_Segments.clear();
+    m_LeadingDirectories = false;
+  }
+
+  for (int i = m_FirstToken; i < m_LastToken; ++i) {
+    if (m_Tokens[i].type == TOKEN_DIRECTORIES) {
+      m_InnerTokens.push_back(i - m_FirstToken);
+    }
+  }
+}
+
+bool GlobPattern::compileSegments(int firstToken)
+{
+  Segment current = { firstToken, firstToken, false };
+  bool inStars = false;
+  for (int i = firstToken; i < m_LastToken; ++i) {
+    TokenType type = m_Tokens[i].type;
+    if (type == TOKEN_DIRECTORIES) {
+      return false;
+    } else if ((type == TOKEN_STAR) || (type == TOKEN_DOUBLESTAR)) {
+      if (!inStars) {
+        m_Segments.push_back(current);
+        current.crossesSeparators = false;
+        inStars = true;
+      }
+      current.crossesSeparators = current.crossesSeparators || (type == TOKEN_DOUBLESTAR);
+      current.firstToken = current.lastToken = i + 1;
+    } else {
+      inStars = false;
+      current.lastToken = i + 1;
+    }
+  }
+  m_Segments.push_back(current);
+
+  // segments are placed at their leftmost possible position. That's only correct if
+  // moving a segment left can't put a separator into the stars following it, which
+  // could happen if the stars before it cross separators but the ones after don't
+  for (size_t i = 1; i + 1 < m_Segments.size(); ++i) {
+    if (!m_Segments[i + 1].crossesSeparators) {
+      if (m_Segments[i].crossesSeparators) {
+        return false;
+      }
+      for (int token = m_Segments[i].firstToken; token < m_Segments[i].lastToken; ++token) {
+        if (m_Tokens[token].type == TOKEN_SEPARATOR) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool GlobPattern::matchClass(const CharClass &charClass, ushort ch) const
+{
+  auto contains = [&charClass] (ushort value) {
+    for (size_t i = 0; i < charClass.ranges.size(); i += 2) {
+      if ((value >= charClass.ranges[i]) && (value <= charClass.ranges[i + 1])) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  bool found = contains(ch)
+               || (!m_CaseSensitive && (contains(foldCase(ch)) || contains(upperCase(ch))));
+  return found != charClass.negated;
+}
+
+bool GlobPattern::matchLiteral(const QString &literal, const QChar *string) const
+{
+  const QChar *expected = literal.constData();
+  for (int i = 0; i < literal.size(); ++i) {
+    ushort ch = string[i].unicode();
+    if (ch == '\\') {
+      ch = '/';
+    } else if (!m_CaseSensitive) {
+      ch = foldCase(ch);
+    }
+    if (ch != expected[i].unicode()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool GlobPattern::findLiteral(const QString &literal, const QChar *string, int length) const
+{
+  const int last = length - literal.size();
+  const ushort first = literal.at(0).unicode();
+  const ushort firstUpper = m_CaseSensitive ? first : upperCase(first);
+  int pos = 0;
+
+#ifdef GLOB_USE_SSE2
+  // find candidates for the first character 8 at a time, then compare the rest
+  const __m128i lower = _mm_set1_epi16(static_cast<short>(first));
+  const __m128i upper = _mm_set1_epi16(static_cast<short>(firstUpper));
+  for (; pos + 8 <= length; pos += 8) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(string + pos));
+    __m128i hits = _mm_or_si128(_mm_cmpeq_epi16(chunk, lower), _mm_cmpeq_epi16(chunk, upper));
+    int mask = _mm_movemask_epi8(hits);
+    while (mask != 0) {
+      int candidate = pos + lowestBit(static_cast<quint64>(mask)) / 2;
+      if (candidate > last) {
+        return false;
+      }
+      if (matchLiteral(literal, string + candidate)) {
+        return true;
+      }
+      // each character sets two bits
+      mask &= mask - 1;
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  for (; pos <= last; ++pos) {
+    ushort ch = string[pos].unicode();
+    if (((ch == first) || (ch == firstUpper)) && matchLiteral(literal, string + pos)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GlobPattern::matchSegment(const Segment &segment, const QChar *string) const
+{
+  for (int i = segment.firstToken; i < segment.lastToken; ++i) {
+    const Token &token = m_Tokens[i];
+    const ushort raw = string[i - segment.firstToken].unicode();
+    const bool separator = isSeparator(raw);
+    bool match = false;
+    switch (token.type) {
+      case TOKEN_CHAR:      match = (m_CaseSensitive ? raw : foldCase(raw)) == token.value; break;
+      case TOKEN_SEPARATOR: match = separator; break;
+      case TOKEN_ANY:       match = !separator; break;
+      case TOKEN_CLASS:     match = !separator && matchClass(m_Classes[token.value], raw); break;
+      default:              match = false; break;
+    }
+    if (!match) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool GlobPattern::matchSegments(const QChar *string, int length) const
+{
+  const Segment &first = m_Segments.front();
+  const int firstLength = first.lastToken - first.firstToken;
+  if (m_Segments.size() == 1) {
+    // no stars at all
+    return (length == firstLength) && matchSegment(first, string);
+  }
+  if ((length < firstLength) || !matchSegment(first, string)) {
+    return false;
+  }
+
+  const Segment &last = m_Segments.back();
+  const int lastStart = length - (last.lastToken - last.firstToken);
+  int pos = firstLength;
+  if (lastStart < pos) {
+    return false;
+  }
+
+  for (size_t i = 1; i + 1 < m_Segments.size(); ++i) {
+    const Segment &segment = m_Segments[i];
+    const int segmentLength = segment.lastToken - segment.firstToken;
+    for (;;) {
+      if (pos + segmentLength > lastStart) {
+        return false;
+      }
+      if (matchSegment(segment, string + pos)) {
+        break;
+      }
+      if (!segment.crossesSeparators && isSeparator(string[pos].unicode())) {
+        return false;
+      }
+      ++pos;
+    }
+    pos += segmentLength;
+  }
+
+  if (!last.crossesSeparators) {
+    for (int i = pos; i < lastStart; ++i) {
+      if (isSeparator(string[i].unicode())) {
+        return false;
+      }
+    }
+  }
+  return matchSegment(last, string + lastStart);
+}
+
+bool GlobPattern::runAutomaton(const QChar *string, int length) const
+{
+  // state i means the first i tokens of the range have been matched. Active states are
+  // kept as a bit set so all of them advance together, there is no backtracking
+  const Token *tokens = m_Tokens.data() + m_FirstToken;
+  const int positionCount = m_LastToken - m_FirstToken + 1;
+  const int stateCount = positionCount + static_cast<int>(m_InnerTokens.size());
+  const int words = (stateCount + 63) / 64;
+
+  // patterns rarely have more than a few hundred states, avoid the allocation for those
+  quint64 localBuffer[8] = { 0 };
+  std::vector<quint64> heapBuffer;
+  quint64 *current = localBuffer;
+  if (words > 4) {
+    heapBuffer.resize(static_cast<size_t>(words) * 2, 0);
+    current = heapBuffer.data();
+  }
+  quint64 *next = current + words;
+
+  auto set = [] (quint64 *bits, int index) { bits[index / 64] |= Q_UINT64_C(1) << (index % 64); };
+  auto test = [] (const quint64 *bits, int index) { return (bits[index / 64] & (Q_UINT64_C(1) << (index % 64))) != 0; };
+  // stars may match nothing, so whenever the state before one is active the state after it is as well
+  auto closure = [&] (quint64 *bits) {
+    for (int i = 0; i < positionCount - 1; ++i) {
+      const TokenType type = tokens[i].type;
+      if (((type == TOKEN_STAR) || (type == TOKEN_DOUBLESTAR) || (type == TOKEN_DIRECTORIES))
+          && test(bits, i)) {
+        set(bits, i + 1);
+      }
+    }
+  };
+
+  set(current, 0);
+  closure(current);
+
+  for (int pos = 0; pos < length; ++pos) {
+    const ushort raw = string[pos].unicode();
+    const bool separator = isSeparator(raw);
+    const ushort ch = m_CaseSensitive ? raw : foldCase(raw);
+
+    std::fill(next, next + words, 0);
+    bool active = false;
+    for (int word = 0; word < words; ++word) {
+      for (quint64 bits = current[word]; bits != 0; bits &= bits - 1) {
+        int state = word * 64 + lowestBit(bits);
+        if (state >= positionCount) {
+          // inside "**/", the only way out is a separator
+          set(next, state);
+          active = true;
+          if (separator) {
+            set(next, m_InnerTokens[state - positionCount] + 1);
+          }
+          continue;
+        } else if (state == positionCount - 1) {
+          continue;
+        }
+        const Token &token = tokens[state];
+        bool advance = false;
+        switch (token.type) {
+          case TOKEN_CHAR:        advance = !separator && (ch == token.value); break;
+          case TOKEN_SEPARATOR:   advance = separator; break;
+          case TOKEN_ANY:         advance = !separator; break;
+          case TOKEN_CLASS:       advance = !separator && matchClass(m_Classes[token.value], raw); break;
+          case TOKEN_STAR: {
+            if (!separator) {
+              set(next, state);
+              active = true;
+            }
+          } break;
+          case TOKEN_DOUBLESTAR: {
+            set(next, state);
+            active = true;
+          } break;
+          case TOKEN_DIRECTORIES: {
+            int inner = static_cast<int>(std::find(m_InnerTokens.begin(), m_InnerTokens.end(), state)
+                                         - m_InnerTokens.begin());
+            set(next, positionCount + inner);
+            active = true;
+            advance = separator;
+          } break;
+        }
+        if (advance) {
+          set(next, state + 1);
+          active = true;
+        }
+      }
+    }
+    if (!active) {
+      return false;
+    }
+    closure(next);
+    std::swap(current, next);
+  }
+
+  return test(current, positionCount - 1);
+}
+
+bool GlobPattern::matches(const QChar *string, int length) const
+{
+  const int fixedLength = m_Prefix.size() + m_Suffix.size();
+  if (length < fixedLength) {
+    return false;
+  }
+  if (!matchLiteral(m_Prefix, string)
+      || !matchLiteral(m_Suffix, string + length - m_Suffix.size())) {
+    return false;
+  }
+
+  const QChar *middle = string + m_Prefix.size();
+  const int middleLength = length - fixedLength;
+  if (m_FirstToken == m_LastToken) {
+    return middleLength == 0;
+  }
+  if (!m_Infix.isEmpty() && !findLiteral(m_Infix, middle, middleLength)) {
+    return false;
+  }
+
+  if (m_Segments.empty()) {
+    return runAutomaton(middle, middleLength);
+  } else if (m_LeadingDirectories) {
+    int start = middleLength;
+    while ((start > 0) && !isSeparator(middle[start - 1].unicode())) {
+      --start;
+    }
+    return matchSegments(middle + start, middleLength - start);
+  } else {
+    return matchSegments(middle, middleLength);
+  }
+}
+
+QStringList GlobPattern::filter(const QStringList &strings) const
+{
+  QStringList result;
+  foreach (const QString &string, strings) {
+    if (matches(string)) {
+      result.append(string);
+    }
+  }
+  return result;
+}
+
+std::function<bool(const QString&)> GlobPattern::predicate() const
+{
+  GlobPattern pattern(*this);
+  return [pattern] (const QString &string) { return pattern.matches(string); };
+}
+
+
+GlobPatternSet::GlobPatternSet(Qt::CaseSensitivity caseSensitivity)
+  : m_CaseSensitivity(caseSensitivity)
+{
+}
+
+GlobPatternSet::GlobPatternSet(const QStringList &patterns, Qt::CaseSensitivity caseSensitivity)
+  : m_CaseSensitivity(caseSensitivity)
+{
+  foreach (const QString &pattern, patterns) {
+    add(pattern);
+  }
+}
+
+void GlobPatternSet::add(const QString &pattern)
+{
+  GlobPattern compiled(pattern, m_CaseSensitivity);
+  // "*" followed by a literal extension
+  const std::vector<GlobPattern::Token> &tokens = compiled.m_Tokens;
+  if ((tokens.size() > 2) && (tokens[0].type == GlobPattern::TOKEN_STAR)
+      && (compiled.m_Suffix.size() == static_cast<int>(tokens.size()) - 1)
+      && compiled.m_Suffix.startsWith('.')
+      && (compiled.m_Suffix.indexOf('.', 1) == -1) && (compiled.m_Suffix.indexOf('/') == -1)) {
+    m_Extensions.insert(compiled.m_Suffix);
+  } else {
+    m_Patterns.push_back(compiled);
+  }
+}
+
+bool GlobPatternSet::matches(const QString &string) const
+{
+  if (!m_Extensions.isEmpty()) {
+    // the extension patterns only apply to strings without separators
+    int dot = -1;
+    bool separator = false;
+    for (int i = string.size() - 1; (i >= 0) && !separator; --i) {
+      ushort ch = string.at(i).unicode();
+      if ((ch == '.') && (dot == -1)) {
+        dot = i;
+      }
+      separator = isSeparator(ch);
+    }
+    if (!separator && (dot != -1)) {
+      QString extension = string.mid(dot);
+      if (m_CaseSensitivity == Qt::CaseInsensitive) {
+        for (int i = 0; i < extension.size(); ++i) {
+          extension[i] = QChar(foldCase(extension.at(i).unicode()));
+        }
+      }
+      if (m_Extensions.contains(extension)) {
+        return true;
+      }
+    }
+  }
+
+  for (const GlobPattern &pattern : m_Patterns) {
+    if (pattern.matches(string)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+QStringList GlobPatternSet::filter(const QStringList &strings) const
+{
+  QStringList result;
+  foreach (const QString &string, strings) {
+    if (matches(string)) {
+      result.append(string);
+    }
+  }
+  return result;
+}
+
+std::function<bool(const QString&)> GlobPatternSet::predicate() const
+{
+  GlobPatternSet patterns(*this);
+  return [patterns] (const QString &string) { return patterns.matches(string); };
+}
+
+} // namespace MOBase
@@ -0,0 +1,214 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef GLOBPATTERN_H
+#define GLOBPATTERN_H
+
+
+#include "dllimport.h"
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <vector>
+
+
+namespace MOBase {
+
+
+/**
+ * @brief a wildcard pattern compiled for fast repeated matching
+ *
+ * Supported syntax:
+ *   - ? matches any single character except a path separator
+ *   - * matches any number of characters except path separators
+ *   - ** matches any number of characters including path separators. "**" followed by a
+ *     separator matches any number of complete directories, including none
+ *   - [abc], [a-z] match one of the listed characters, [!abc] or [^abc] any other character
+ * / and \ are treated as the same separator. The pattern has to match the whole string, so
+ * "*.esp" matches "foo.esp" but not "data/foo.esp".
+ *
+ * Literal parts at the start and end of the pattern are compared directly and the longest
+ * literal in between is searched with SIMD before the pattern is evaluated, so most strings
+ * that don't match are rejected without running the automaton.
+ */
+class QDLLEXPORT GlobPattern
+{
+public:
+
+  GlobPattern();
+
+  /**
+   * @param pattern the wildcard pattern
+   * @param caseSensitivity whether letters have to match in case. The default matches
+   *        how file names are compared on windows
+   */
+  explicit GlobPattern(const QString &pattern, Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive);
+
+  /**
+   * @return the pattern this was compiled from
+   */
+  QString pattern() const { return m_Pattern; }
+
+  /**
+   * @return true if the pattern contains no wildcards at all
+   */
+  bool isLiteral() const { return m_Tokens.size() == m_Prefix.size(); }
+
+  /**
+   * @brief test if the string matches the pattern
+   */
+  bool matches(const QString &string) const { return matches(string.constData(), string.size()); }
+
+  bool matches(const QChar *string, int length) const;
+
+  /**
+   * @return the strings from the list that match the pattern, in the same order
+   */
+  QStringList filter(const QStringList &strings) const;
+
+  /**
+   * @return a predicate that can be passed to functions taking a filter, like IOrganizer::findFiles
+   */
+  std::function<bool(const QString&)> predicate() const;
+
+private:
+
+  friend class GlobPatternSet;
+
+  enum TokenType {
+    TOKEN_CHAR,
+    TOKEN_SEPARATOR,
+    TOKEN_ANY,
+    TOKEN_CLASS,
+    TOKEN_STAR,
+    TOKEN_DOUBLESTAR,
+    // "**/", any number of complete directories including none
+    TOKEN_DIRECTORIES
+  };
+
+  struct Token {
+    TokenType type;
+    // the character for TOKEN_CHAR (folded unless case sensitive), the class index for TOKEN_CLASS
+    ushort value;
+  };
+
+  struct CharClass {
+    bool negated;
+    // pairs of first and last character of each range
+    std::vector<ushort> ranges;
+  };
+
+  // tokens of fixed length between two runs of stars
+  struct Segment {
+    int firstToken;
+    int lastToken;
+    // whether the stars before this segment can match separators
+    bool crossesSeparators;
+  };
+
+private:
+
+  void compile();
+  bool compileSegments(int firstToken);
+  bool matchClass(const CharClass &charClass, ushort ch) const;
+  bool matchLiteral(const QString &literal, const QChar *string) const;
+  bool findLiteral(const QString &literal, const QChar *string, int length) const;
+  bool matchSegment(const Segment &segment, const QChar *string) const;
+  bool matchSegments(const QChar *string, int length) const;
+  bool runAutomaton(const QChar *string, int length) const;
+
+private:
+
+  QString m_Pattern;
+  bool m_CaseSensitive;
+  std::vector<Token> m_Tokens;
+  std::vector<CharClass> m_Classes;
+
+  // literal characters the pattern starts and ends with. Separators are stored as '/'
+  QString m_Prefix;
+  QString m_Suffix;
+  // the longest literal run in between, empty if there is none worth searching for
+  QString m_Infix;
+  // range of tokens that remain for the automaton once prefix and suffix matched
+  int m_FirstToken;
+  int m_LastToken;
+
+  // if possible, the remaining tokens are matched segment by segment, which is a lot
+  // cheaper than the automaton. Empty if the automaton is required
+  std::vector<Segment> m_Segments;
+  // the remaining tokens start with "**/" and the segments can only match the last path component
+  bool m_LeadingDirectories;
+
+  // "**/" needs a second automaton state for having consumed part of a directory name. These
+  // follow the regular states, m_InnerTokens holds the token (relative to m_FirstToken) of each
+  std::vector<int> m_InnerTokens;
+
+};
+
+
+/**
+ * @brief a list of patterns that matches a string if any of its patterns does
+ *
+ * Patterns of the form "*.ext" are looked up by extension in a hash instead of
+ * being tested one by one, so long lists of file types are cheap.
+ */
+class QDLLEXPORT GlobPatternSet
+{
+public:
+
+  explicit GlobPatternSet(Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive);
+
+  /**
+   * @param patterns the patterns to add
+   */
+  explicit GlobPatternSet(const QStringList &patterns, Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive);
+
+  void add(const QString &pattern);
+
+  bool isEmpty() const { return m_Extensions.isEmpty() && m_Patterns.empty(); }
+
+  /**
+   * @return true if any of the patterns matches the string
+   */
+  bool matches(const QString &string) const;
+
+  /**
+   * @return the strings from the list that match any pattern, in the same order
+   */
+  QStringList filter(const QStringList &strings) const;
+
+  /**
+   * @return a predicate that can be passed to functions taking a filter, like IOrganizer::findFiles
+   */
+  std::function<bool(const QString&)> predicate() const;
+
+private:
+
+  Qt::CaseSensitivity m_CaseSensitivity;
+  // extensions (including the dot) of all "*.ext" patterns, folded unless case sensitive
+  QSet<QString> m_Extensions;
+  std::vector<GlobPattern> m_Patterns;
+
+};
+
+} // namespace MOBase
+
+#endif // GLOBPATTERN_H
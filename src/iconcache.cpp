@@ -0,0 +1,211 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "iconcache.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#ifdef Q_OS_WIN
+#include "utility.h"
+#include <QtWinExtras/QtWin>
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <shellapi.h>
+#endif
+
+
+namespace MOBase {
+
+
+static QImage extractExecutableIcon(const QString &filePath)
+{
+#ifdef Q_OS_WIN
+  HICON winIcon;
+  UINT res = ::ExtractIconExW(ToWString(filePath).c_str(), 0, &winIcon, nullptr, 1);
+  if (res == 1) {
+    QImage result = QtWin::imageFromHICON(winIcon);
+    ::DestroyIcon(winIcon);
+    return result;
+  }
+#else
+  Q_UNUSED(filePath);
+#endif
+  return QImage();
+}
+
+
+IconCache::IconCache(const Extractor &extractor, const QString &cacheDirectory, int capacity)
+  : m_Extractor(extractor)
+  , m_CacheDirectory(cacheDirectory)
+  , m_Memory(capacity)
+{
+  m_Statistics.memoryHits = 0;
+  m_Statistics.diskHits = 0;
+  m_Statistics.extractions = 0;
+}
+
+IconCache &IconCache::instance()
+{
+  static IconCache s_Instance(&extractExecutableIcon,
+                              QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/icons");
+  return s_Instance;
+}
+
+QString IconCache::key(const QString &filePath)
+{
+  QString result = QDir::cleanPath(QFileInfo(filePath).absoluteFilePath());
+#ifdef Q_OS_WIN
+  // file names are case insensitive
+  result = result.toLower();
+#endif
+  return result;
+}
+
+QString IconCache::diskFileName(const QString &cacheDirectory, const QString &key)
+{
+  return cacheDirectory + "/"
+       + QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex())
+       + ".png";
+}
+
+bool IconCache::readDisk(const QString &fileName, qint64 size, const QDateTime &modified, QImage &image)
+{
+  QImageReader reader(fileName, "png");
+  // the text keys come from the header, the pixel data is only decoded if they match
+  if (!reader.canRead()
+      || (reader.text("size") != QString::number(size))
+      || (reader.text("modified") != QString::number(modified.toMSecsSinceEpoch()))) {
+    return false;
+  }
+  if (reader.text("empty") == "1") {
+    image = QImage();
+    return true;
+  }
+  image = reader.read();
+  return !image.isNull();
+}
+
+void IconCache::writeDisk(const QString &fileName, qint64 size, const QDateTime &modified, const QImage &image)
+{
+  QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+  // files without an icon are remembered too so they don't get parsed again
+  QImage output = image;
+  if (output.isNull()) {
+    output = QImage(1, 1, QImage::Format_ARGB32);
+    output.fill(Qt::transparent);
+  }
+
+  QSaveFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly)) {
+    return;
+  }
+  QImageWriter writer(&file, "png");
+  writer.setText("size", QString::number(size));
+  writer.setText("modified", QString::number(modified.toMSecsSinceEpoch()));
+  if (image.isNull()) {
+    writer.setText("empty", "1");
+  }
+  if (writer.write(output)) {
+    file.commit();
+  } else {
+    qWarning("failed to write icon cache file %s: %s", qPrintable(fileName), qPrintable(writer.errorString()));
+    file.cancelWriting();
+  }
+}
+
+QImage IconCache::image(const QString &filePath)
+{
+  QFileInfo fileInfo(filePath);
+  qint64 size = fileInfo.size();
+  QDateTime modified = fileInfo.lastModified();
+  QString fileKey = key(filePath);
+
+  Extractor extractor;
+  QString cacheDirectory;
+  {
+    QMutexLocker locker(&m_Mutex);
+    Entry *entry = m_Memory.object(fileKey);
+    if ((entry != nullptr) && (entry->size == size) && (entry->modified == modified)) {
+      ++m_Statistics.memoryHits;
+      return entry->image;
+    }
+    extractor = m_Extractor;
+    cacheDirectory = m_CacheDirectory;
+  }
+
+  // the lock isn't held while reading or extracting so other threads aren't blocked
+  QImage result;
+  bool fromDisk = false;
+  QString diskName;
+  if (!cacheDirectory.isEmpty()) {
+    diskName = diskFileName(cacheDirectory, fileKey);
+    fromDisk = readDisk(diskName, size, modified, result);
+  }
+  if (!fromDisk) {
+    if (extractor) {
+      result = extractor(filePath);
+    }
+    if (!diskName.isEmpty()) {
+      writeDisk(diskName, size, modified, result);
+    }
+  }
+
+  QMutexLocker locker(&m_Mutex);
+  if (fromDisk) {
+    ++m_Statistics.diskHits;
+  } else {
+    ++m_Statistics.extractions;
+  }
+  m_Memory.insert(fileKey, new Entry({ size, modified, result }));
+  return result;
+}
+
+void IconCache::setExtractor(const Extractor &extractor)
+{
+  QMutexLocker locker(&m_Mutex);
+  m_Extractor = extractor;
+}
+
+void IconCache::setCacheDirectory(const QString &cacheDirectory)
+{
+  QMutexLocker locker(&m_Mutex);
+  m_CacheDirectory = cacheDirectory;
+}
+
+void IconCache::clear()
+{
+  QMutexLocker locker(&m_Mutex);
+  m_Memory.clear();
+}
+
+IconCache::Statistics IconCache::statistics() const
+{
+  QMutexLocker locker(&m_Mutex);
+  return m_Statistics;
+}
+
+} // namespace MOBase
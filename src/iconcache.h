@@ -0,0 +1,134 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ICONCACHE_H
+#define ICONCACHE_H
+
+
+#include "dllimport.h"
+#include <QCache>
+#include <QDateTime>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <functional>
+
+
+namespace MOBase {
+
+
+/**
+ * @brief caches icons extracted from files, in memory and on disk
+ *
+ * Entries are keyed by the path of the file and validated against its size and
+ * modification time, so a changed file gets its icon extracted again. The most recently
+ * used icons are kept in memory, all others are loaded from the disk cache which
+ * survives restarts. Only if neither has a valid entry the extractor is called.
+ */
+class QDLLEXPORT IconCache
+{
+public:
+
+  /**
+   * @brief function that retrieves the icon of a file. Returns a null image if the file
+   *        has no icon
+   */
+  typedef std::function<QImage (const QString &filePath)> Extractor;
+
+  struct Statistics {
+    int memoryHits;
+    int diskHits;
+    int extractions;
+  };
+
+public:
+
+  /**
+   * @param extractor function used to get icons that aren't cached yet
+   * @param cacheDirectory directory for the persistent cache. If this is empty, icons are
+   *                       only cached in memory
+   * @param capacity maximum number of icons kept in memory
+   */
+  IconCache(const Extractor &extractor, const QString &cacheDirectory = QString(), int capacity = 256);
+
+  /**
+   * @return the cache used by iconForExecutable. On windows it extracts the icon
+   *         resources of executables
+   */
+  static IconCache &instance();
+
+  /**
+   * @brief retrieve the icon of a file
+   * @param filePath path of the file
+   * @return the icon or a null image if the file has no icon
+   */
+  QImage image(const QString &filePath);
+
+  /**
+   * @brief change the extractor. Entries that are already cached are kept
+   */
+  void setExtractor(const Extractor &extractor);
+
+  /**
+   * @brief change the directory of the persistent cache. An empty name disables it
+   */
+  void setCacheDirectory(const QString &cacheDirectory);
+
+  /**
+   * @brief drop all icons from memory. The persistent cache is not affected
+   */
+  void clear();
+
+  /**
+   * @return number of lookups answered by each level so far
+   */
+  Statistics statistics() const;
+
+private:
+
+  struct Entry {
+    qint64 size;
+    QDateTime modified;
+    QImage image;
+  };
+
+private:
+
+  static QString key(const QString &filePath);
+
+  static QString diskFileName(const QString &cacheDirectory, const QString &key);
+  static bool readDisk(const QString &fileName, qint64 size, const QDateTime &modified, QImage &image);
+  static void writeDisk(const QString &fileName, qint64 size, const QDateTime &modified, const QImage &image);
+
+private:
+
+  Q_DISABLE_COPY(IconCache)
+
+  mutable QMutex m_Mutex;
+  Extractor m_Extractor;
+  QString m_CacheDirectory;
+  QCache<QString, Entry> m_Memory;
+  Statistics m_Statistics;
+
+};
+
+} // namespace MOBase
+
+#endif // ICONCACHE_H
@@ -1,2 +1,18 @@
 #include "imodrepositorybridge.h"
 
+namespace MOBase {
+
+IModRepositoryBridge::IModRepositoryBridge(QObject *parent)
+  : QObject(parent)
+{
+  static bool s_Registered = [] {
+    qRegisterMetaType<ModRepositoryFileInfo>();
+    // the signal spells the type without the namespace, string based connections look
+    // it up by that name
+    qRegisterMetaType<QList<ModRepositoryFileInfo>>("QList<ModRepositoryFileInfo>");
+    return true;
+  }();
+  Q_UNUSED(s_Registered);
+}
+
+} // namespace MOBase
@@ -15,7 +15,10 @@ class QDLLEXPORT IModRepositoryBridge : public QObject
   Q_OBJECT
 public:
 
-  IModRepositoryBridge(QObject *parent = nullptr) : QObject(parent) {}
+  /**
+   * @brief constructor. Registers the types used in signals so they can be queued
+   */
+  IModRepositoryBridge(QObject *parent = nullptr);
 
   /**
    * @brief request description for a mod
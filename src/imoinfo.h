@@ -196,6 +196,8 @@ public:
    * @param path the path to search in
    * @param filter filter function to match against
    * @return a list of matching files
+   * @note for wildcard filters, use GlobPattern::predicate() (globpattern.h) instead of
+   *       building a QRegExp in the filter
    */
   virtual QStringList findFiles(const QString &path, const std::function<bool(const QString&)> &filter) const = 0;
 
@@ -21,10 +21,15 @@
  */
 
 #include "json.h"
+#include <QIODevice>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <algorithm>
+#include <cstring>
 
 namespace QtJson {
-    static QString sanitizeString(QString str);
-    static QByteArray join(const QList<QByteArray> &list, const QByteArray &sep);
     static QVariant parseValue(const QString &json, int &index, bool &success);
     static QVariant parseObject(const QString &json, int &index, bool &success);
     static QVariant parseArray(const QString &json, int &index, bool &success);
@@ -35,22 +40,200 @@ namespace QtJson {
     static int lookAhead(const QString &json, int index);
     static int nextToken(const QString &json, int &index);
 
+    /**
+     * \class JsonWriter
+     * \brief Generates JSON text into a single growing buffer
+     *
+     * All nested values are appended to the same buffer so nothing is copied once
+     * per nesting level. If a device is set, the buffer is handed to the device
+     * whenever it grows beyond the block size.
+     */
+    class JsonWriter {
+    public:
+        JsonWriter(QByteArray &buffer, QIODevice *device, SerializeStyle style)
+            : m_Buffer(buffer), m_Device(device), m_Style(style), m_Success(true) {
+            if (m_Device != nullptr) {
+                // reserving marks the capacity as reserved so resize(0) won't release it
+                m_Buffer.reserve(BlockSize + BlockSize / 4);
+            }
+        }
+
+        bool write(const QVariant &data) {
+            writeValue(data);
+            flush();
+            return m_Success;
+        }
+
+    private:
+        enum { BlockSize = 64 * 1024 };
+
+        void writeValue(const QVariant &data);
+        void writeString(const QString &str);
+        void writeList(const QVariantList &list);
+        template<typename T> void writeMap(const T &map);
+
+        void writeSeparator(const char *readable, char compact) {
+            if (m_Style == StyleCompact) {
+                m_Buffer.append(compact);
+            } else {
+                m_Buffer.append(readable);
+            }
+        }
+
+        void flushIfFull() {
+            if ((m_Device != nullptr) && (m_Buffer.size() >= BlockSize)) {
+                flush();
+            }
+        }
+
+        void flush() {
+            if ((m_Device != nullptr) && !m_Buffer.isEmpty()) {
+                if (m_Device->write(m_Buffer) != m_Buffer.size()) {
+                    m_Success = false;
+                }
+                m_Buffer.resize(0);
+            }
+        }
+
+    private:
+        QByteArray &m_Buffer;
+        QIODevice *m_Device;
+        SerializeStyle m_Style;
+        bool m_Success;
+    };
+
+    void JsonWriter::writeValue(const QVariant &data) {
+        if (!m_Success) {
+            return;
+        }
+
+        if (!data.isValid()) { // invalid or null?
+            m_Buffer.append("null");
+        } else if ((data.type() == QVariant::List) ||
+                   (data.type() == QVariant::StringList)) { // variant is a list?
+            writeList(data.toList());
+        } else if (data.type() == QVariant::Hash) { // variant is a hash?
+            writeMap<>(data.toHash());
+        } else if (data.type() == QVariant::Map) { // variant is a map?
+            writeMap<>(data.toMap());
+        } else if ((data.type() == QVariant::String) ||
+                   (data.type() == QVariant::ByteArray)) {// a string or a byte array?
+            writeString(data.toString());
+        } else if (data.type() == QVariant::Double) { // double?
+            double value = data.toDouble();
+            if ((value - value) == 0.0) {
+                QByteArray str = QByteArray::number(value, 'g');
+                m_Buffer.append(str);
+                if (!str.contains(".") && ! str.contains("e")) {
+                    m_Buffer.append(".0");
+                }
+            } else {
+                m_Success = false;
+            }
+        } else if (data.type() == QVariant::Bool) { // boolean value?
+            m_Buffer.append(data.toBool() ? "true" : "false");
+        } else if (data.type() == QVariant::ULongLong) { // large unsigned number?
+            m_Buffer.append(QByteArray::number(data.value<qulonglong>()));
+        } else if (data.canConvert<qlonglong>()) { // any signed number?
+            m_Buffer.append(QByteArray::number(data.value<qlonglong>()));
+        } else if (data.canConvert<QString>()) { // can value be converted to string?
+            // this will catch QDate, QDateTime, QUrl, ...
+            writeString(data.toString());
+        } else {
+            m_Success = false;
+        }
+
+        flushIfFull();
+    }
+
+    void JsonWriter::writeList(const QVariantList &list) {
+        writeSeparator("[ ", '[');
+        bool first = true;
+        for (QVariantList::const_iterator iter = list.begin(); iter != list.end() && m_Success; ++iter) {
+            if (!first) {
+                writeSeparator(", ", ',');
+            }
+            first = false;
+            writeValue(*iter);
+        }
+        writeSeparator(" ]", ']');
+    }
+
     template<typename T>
-    QByteArray serializeMap(const T &map, bool &success) {
-        QByteArray str = "{ ";
-        QList<QByteArray> pairs;
-        for (typename T::const_iterator it = map.begin(), itend = map.end(); it != itend; ++it) {
-            QByteArray serializedValue = serialize(it.value());
-            if (serializedValue.isNull()) {
-                success = false;
-                break;
+    void JsonWriter::writeMap(const T &map) {
+        writeSeparator("{ ", '{');
+        bool first = true;
+        for (typename T::const_iterator it = map.begin(), itend = map.end(); it != itend && m_Success; ++it) {
+            if (!first) {
+                writeSeparator(", ", ',');
             }
-            pairs << sanitizeString(it.key()).toUtf8() + " : " + serializedValue;
+            first = false;
+            writeString(it.key());
+            writeSeparator(" : ", ':');
+            writeValue(it.value());
         }
+        writeSeparator(" }", '}');
+    }
 
-        str += join(pairs, ", ");
-        str += " }";
-        return str;
+    /**
+     * writeString
+     *
+     * escapes the string and encodes it to UTF-8 in the same pass
+     */
+    void JsonWriter::writeString(const QString &str) {
+        static const char hexDigits[] = "0123456789abcdef";
+
+        m_Buffer.append('"');
+        const ushort *pos = str.utf16();
+        const ushort *end = pos + str.size();
+        for (; pos != end; ++pos) {
+            uint c = *pos;
+            if (c < 0x80) {
+                switch (c) {
+                    case '"':  m_Buffer.append("\\\""); break;
+                    case '\\': m_Buffer.append("\\\\"); break;
+                    case '\b': m_Buffer.append("\\b"); break;
+                    case '\f': m_Buffer.append("\\f"); break;
+                    case '\n': m_Buffer.append("\\n"); break;
+                    case '\r': m_Buffer.append("\\r"); break;
+                    case '\t': m_Buffer.append("\\t"); break;
+                    default: {
+                        if (c < 0x20) {
+                            m_Buffer.append("\\u00");
+                            m_Buffer.append(hexDigits[c >> 4]);
+                            m_Buffer.append(hexDigits[c & 0xF]);
+                        } else {
+                            m_Buffer.append(static_cast<char>(c));
+                        }
+                    } break;
+                }
+                continue;
+            }
+
+            if (QChar::isSurrogate(c)) {
+                if (QChar::isHighSurrogate(c) && (pos + 1 != end) && QChar::isLowSurrogate(pos[1])) {
+                    c = QChar::surrogateToUcs4(static_cast<ushort>(c), pos[1]);
+                    ++pos;
+                } else {
+                    // unpaired surrogate, can't be represented in UTF-8
+                    c = QChar::ReplacementCharacter;
+                }
+            }
+
+            if (c < 0x800) {
+                m_Buffer.append(static_cast<char>(0xC0 | (c >> 6)));
+            } else {
+                if (c < 0x10000) {
+                    m_Buffer.append(static_cast<char>(0xE0 | (c >> 12)));
+                } else {
+                    m_Buffer.append(static_cast<char>(0xF0 | (c >> 18)));
+                    m_Buffer.append(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                }
+                m_Buffer.append(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+            }
+            m_Buffer.append(static_cast<char>(0x80 | (c & 0x3F)));
+        }
+        m_Buffer.append('"');
     }
 
 
@@ -91,56 +274,12 @@ namespace QtJson {
     }
 
     QByteArray serialize(const QVariant &data, bool &success) {
-        QByteArray str;
-        success = true;
-
-        if (!data.isValid()) { // invalid or null?
-            str = "null";
-        } else if ((data.type() == QVariant::List) ||
-                   (data.type() == QVariant::StringList)) { // variant is a list?
-            QList<QByteArray> values;
-            const QVariantList list = data.toList();
-            Q_FOREACH(const QVariant& v, list) {
-                QByteArray serializedValue = serialize(v);
-                if (serializedValue.isNull()) {
-                    success = false;
-                    break;
-                }
-                values << serializedValue;
-            }
+        return serialize(data, success, StyleReadable);
+    }
 
-            str = "[ " + join( values, ", " ) + " ]";
-        } else if (data.type() == QVariant::Hash) { // variant is a hash?
-            str = serializeMap<>(data.toHash(), success);
-        } else if (data.type() == QVariant::Map) { // variant is a map?
-            str = serializeMap<>(data.toMap(), success);
-        } else if ((data.type() == QVariant::String) ||
-                   (data.type() == QVariant::ByteArray)) {// a string or a byte array?
-            str = sanitizeString(data.toString()).toUtf8();
-        } else if (data.type() == QVariant::Double) { // double?
-            double value = data.toDouble();
-            if ((value - value) == 0.0) {
-                str = QByteArray::number(value, 'g');
-                if (!str.contains(".") && ! str.contains("e")) {
-                    str += ".0";
-                }
-            } else {
-                success = false;
-            }
-        } else if (data.type() == QVariant::Bool) { // boolean value?
-            str = data.toBool() ? "true" : "false";
-        } else if (data.type() == QVariant::ULongLong) { // large unsigned number?
-            str = QByteArray::number(data.value<qulonglong>());
-        } else if (data.canConvert<qlonglong>()) { // any signed number?
-            str = QByteArray::number(data.value<qlonglong>());
-        } else if (data.canConvert<long>()) { //TODO: this code is never executed
-            str = QString::number(data.value<long>()).toUtf8();
-        } else if (data.canConvert<QString>()) { // can value be converted to string?
-            // this will catch QDate, QDateTime, QUrl, ...
-            str = sanitizeString(data.toString()).toUtf8();
-        } else {
-            success = false;
-        }
+    QByteArray serialize(const QVariant &data, bool &success, SerializeStyle style) {
+        QByteArray str;
+        success = JsonWriter(str, nullptr, style).write(data);
 
         if (success) {
             return str;
@@ -149,6 +288,11 @@ namespace QtJson {
         }
     }
 
+    bool serialize(const QVariant &data, QIODevice *device, SerializeStyle style) {
+        QByteArray buffer;
+        return JsonWriter(buffer, device, style).write(data);
+    }
+
     QString serializeStr(const QVariant &data) {
         return QString::fromUtf8(serialize(data));
     }
@@ -176,28 +320,6 @@ namespace QtJson {
         JsonTokenNull = 11
     };
 
-    static QString sanitizeString(QString str) {
-        str.replace(QLatin1String("\\"), QLatin1String("\\\\"));
-        str.replace(QLatin1String("\""), QLatin1String("\\\""));
-        str.replace(QLatin1String("\b"), QLatin1String("\\b"));
-        str.replace(QLatin1String("\f"), QLatin1String("\\f"));
-        str.replace(QLatin1String("\n"), QLatin1String("\\n"));
-        str.replace(QLatin1String("\r"), QLatin1String("\\r"));
-        str.replace(QLatin1String("\t"), QLatin1String("\\t"));
-        return QString(QLatin1String("\"%1\"")).arg(str);
-    }
-
-    static QByteArray join(const QList<QByteArray> &list, const QByteArray &sep) {
-        QByteArray res;
-        Q_FOREACH(const QByteArray &i, list) {
-            if (!res.isEmpty()) {
-                res += sep;
-            }
-            res += i;
-        }
-        return res;
-    }
-
     /**
      * parseValue
      */
@@ -519,4 +641,696 @@ namespace QtJson {
 
         return JsonTokenNone;
     }
+
+
+    /**
+     * isNumberCharacter
+     */
+    static bool isNumberCharacter(char c) {
+        return ((c >= '0') && (c <= '9')) || (c == '-') || (c == '+') || (c == '.') || (c == 'e') || (c == 'E');
+    }
+
+    /**
+     * LazyDocument::parse
+     *
+     * Records every value as a node in document order. Containers are followed
+     * by their children and know the index of the first node after them so
+     * subtrees can be skipped in constant time.
+     */
+    bool LazyDocument::parse(const QByteArray &json) {
+        m_Data = json;
+        m_Nodes.clear();
+
+        const char *data = m_Data.constData();
+        const int size = m_Data.size();
+        int pos = 0;
+
+        // indices of the containers that haven't been closed yet
+        std::vector<int> open;
+        bool needValue = true;
+        bool allowClose = false;
+
+        auto skipWhitespace = [&]() {
+            while ((pos < size) && ((data[pos] == ' ') || (data[pos] == '\t') ||
+                                    (data[pos] == '\n') || (data[pos] == '\r'))) {
+                ++pos;
+            }
+        };
+
+        auto failed = [&]() -> bool {
+            m_Nodes.clear();
+            return false;
+        };
+
+        auto addNode = [&](int type, int begin, int end) {
+            Node node = { type, false, begin, end, static_cast<int>(m_Nodes.size()) + 1, 0 };
+            m_Nodes.push_back(node);
+        };
+
+        auto scanString = [&]() -> bool {
+            int begin = ++pos;
+            bool escaped = false;
+            while (pos < size) {
+                char c = data[pos];
+                if (c == '"') {
+                    addNode(LazyValue::TypeString, begin, pos);
+                    m_Nodes.back().escaped = escaped;
+                    ++pos;
+                    return true;
+                } else if (c == '\\') {
+                    escaped = true;
+                    pos += 2;
+                } else {
+                    ++pos;
+                }
+            }
+            return false;
+        };
+
+        auto scanLiteral = [&](const char *literal, int length) -> bool {
+            if ((size - pos < length) || (memcmp(data + pos, literal, length) != 0)) {
+                return false;
+            }
+            pos += length;
+            return true;
+        };
+
+        auto closeContainer = [&]() {
+            Node &node = m_Nodes[open.back()];
+            ++pos;
+            node.end = pos;
+            node.next = static_cast<int>(m_Nodes.size());
+            open.pop_back();
+        };
+
+        auto closingChar = [&]() -> char {
+            return m_Nodes[open.back()].type == LazyValue::TypeObject ? '}' : ']';
+        };
+
+        for (;;) {
+            skipWhitespace();
+            if (pos == size) {
+                return failed();
+            }
+            char c = data[pos];
+
+            if (!needValue) {
+                // a value inside a container was completed
+                if (c == ',') {
+                    ++pos;
+                    needValue = true;
+                } else if (c == closingChar()) {
+                    closeContainer();
+                    if (open.empty()) {
+                        break;
+                    }
+                } else {
+                    return failed();
+                }
+                continue;
+            }
+
+            if (!open.empty()) {
+                if (allowClose && (c == closingChar())) {
+                    allowClose = false;
+                    needValue = false;
+                    closeContainer();
+                    if (open.empty()) {
+                        break;
+                    }
+                    continue;
+                }
+
+                Node &parent = m_Nodes[open.back()];
+                ++parent.count;
+                if (parent.type == LazyValue::TypeObject) {
+                    if ((c != '"') || !scanString()) {
+                        return failed();
+                    }
+                    skipWhitespace();
+                    if ((pos == size) || (data[pos] != ':')) {
+                        return failed();
+                    }
+                    ++pos;
+                    skipWhitespace();
+                    if (pos == size) {
+                        return failed();
+                    }
+                    c = data[pos];
+                }
+            }
+
+            allowClose = false;
+            switch (c) {
+                case '{':
+                case '[': {
+                    addNode(c == '{' ? LazyValue::TypeObject : LazyValue::TypeArray, pos, -1);
+                    open.push_back(static_cast<int>(m_Nodes.size()) - 1);
+                    ++pos;
+                    allowClose = true;
+                    continue;
+                }
+                case '"': {
+                    if (!scanString()) {
+                        return failed();
+                    }
+                } break;
+                case 't': {
+                    if (!scanLiteral("true", 4)) {
+                        return failed();
+                    }
+                    addNode(LazyValue::TypeBool, pos - 4, pos);
+                } break;
+                case 'f': {
+                    if (!scanLiteral("false", 5)) {
+                        return failed();
+                    }
+                    addNode(LazyValue::TypeBool, pos - 5, pos);
+                } break;
+                case 'n': {
+                    if (!scanLiteral("null", 4)) {
+                        return failed();
+                    }
+                    addNode(LazyValue::TypeNull, pos - 4, pos);
+                } break;
+                default: {
+                    if (((c < '0') || (c > '9')) && (c != '-')) {
+                        return failed();
+                    }
+                    int begin = pos;
+                    while ((pos < size) && isNumberCharacter(data[pos])) {
+                        ++pos;
+                    }
+                    addNode(LazyValue::TypeNumber, begin, pos);
+                } break;
+            }
+
+            needValue = false;
+            if (open.empty()) {
+                // the top level value was a scalar
+                break;
+            }
+        }
+
+        // only whitespace may follow the top level value
+        skipWhitespace();
+        if (pos != size) {
+            return failed();
+        }
+
+        return true;
+    }
+
+    LazyValue LazyDocument::root() const {
+        if (m_Nodes.empty()) {
+            return LazyValue();
+        }
+        return LazyValue(this, 0);
+    }
+
+    /**
+     * LazyDocument::decodeString
+     */
+    QString LazyDocument::decodeString(const Node &node) const {
+        const char *data = m_Data.constData();
+        if (!node.escaped) {
+            return QString::fromUtf8(data + node.begin, node.end - node.begin);
+        }
+
+        QString result;
+        result.reserve(node.end - node.begin);
+        int runBegin = node.begin;
+        int pos = node.begin;
+        while (pos < node.end) {
+            if (data[pos] != '\\') {
+                ++pos;
+                continue;
+            }
+            result.append(QString::fromUtf8(data + runBegin, pos - runBegin));
+            ++pos;
+            char c = data[pos++];
+            switch (c) {
+                case 'b': result.append(QChar('\b')); break;
+                case 'f': result.append(QChar('\f')); break;
+                case 'n': result.append(QChar('\n')); break;
+                case 'r': result.append(QChar('\r')); break;
+                case 't': result.append(QChar('\t')); break;
+                case 'u': {
+                    if (node.end - pos >= 4) {
+                        bool ok = false;
+                        ushort symbol = QByteArray::fromRawData(data + pos, 4).toUShort(&ok, 16);
+                        if (ok) {
+                            result.append(QChar(symbol));
+                        }
+                        pos += 4;
+                    } else {
+                        pos = node.end;
+                    }
+                } break;
+                default: result.append(QLatin1Char(c)); break;
+            }
+            runBegin = pos;
+        }
+        result.append(QString::fromUtf8(data + runBegin, node.end - runBegin));
+        return result;
+    }
+
+    /**
+     * LazyDocument::decodeNumber
+     */
+    QVariant LazyDocument::decodeNumber(const Node &node) const {
+        QByteArray numberStr = QByteArray::fromRawData(m_Data.constData() + node.begin, node.end - node.begin);
+        bool ok;
+
+        // same rules as parseNumber, an exponent alone doesn't make a double
+        if (numberStr.contains('.')) {
+            return QVariant(numberStr.toDouble(nullptr));
+        } else if (numberStr.startsWith('-')) {
+            int i = numberStr.toInt(&ok);
+            if (!ok) {
+                qlonglong ll = numberStr.toLongLong(&ok);
+                return ok ? ll : QVariant(QString::fromLatin1(numberStr));
+            }
+            return i;
+        } else {
+            uint u = numberStr.toUInt(&ok);
+            if (!ok) {
+                qulonglong ull = numberStr.toULongLong(&ok);
+                return ok ? ull : QVariant(QString::fromLatin1(numberStr));
+            }
+            return u;
+        }
+    }
+
+    /**
+     * LazyDocument::toVariant
+     */
+    QVariant LazyDocument::toVariant(int index) const {
+        const Node &node = m_Nodes[index];
+        switch (node.type) {
+            case LazyValue::TypeNull: {
+                return QVariant();
+            }
+            case LazyValue::TypeBool: {
+                return QVariant(m_Data.at(node.begin) == 't');
+            }
+            case LazyValue::TypeNumber: {
+                return decodeNumber(node);
+            }
+            case LazyValue::TypeString: {
+                return QVariant(decodeString(node));
+            }
+            case LazyValue::TypeArray: {
+                QVariantList list;
+                list.reserve(node.count);
+                int child = index + 1;
+                for (int i = 0; i < node.count; ++i) {
+                    list.append(toVariant(child));
+                    child = m_Nodes[child].next;
+                }
+                return QVariant(list);
+            }
+            case LazyValue::TypeObject: {
+                QVariantMap map;
+                int child = index + 1;
+                for (int i = 0; i < node.count; ++i) {
+                    map[decodeString(m_Nodes[child])] = toVariant(child + 1);
+                    child = m_Nodes[child + 1].next;
+                }
+                return QVariant(map);
+            }
+            default: {
+                return QVariant();
+            }
+        }
+    }
+
+    LazyValue::Type LazyValue::type() const {
+        if (m_Document == nullptr) {
+            return TypeInvalid;
+        }
+        return static_cast<Type>(m_Document->m_Nodes[m_Node].type);
+    }
+
+    int LazyValue::size() const {
+        Type t = type();
+        if ((t != TypeArray) && (t != TypeObject)) {
+            return 0;
+        }
+        return m_Document->m_Nodes[m_Node].count;
+    }
+
+    LazyValue LazyValue::at(int index) const {
+        if ((type() != TypeArray) || (index < 0) || (index >= size())) {
+            return LazyValue();
+        }
+        int child = m_Node + 1;
+        for (int i = 0; i < index; ++i) {
+            child = m_Document->m_Nodes[child].next;
+        }
+        return LazyValue(m_Document, child);
+    }
+
+    LazyValue LazyValue::value(const QString &key) const {
+        QByteArray utf8Key = key.toUtf8();
+        return findMember(utf8Key.constData(), utf8Key.size());
+    }
+
+    LazyValue LazyValue::value(const char *key) const {
+        return findMember(key, static_cast<int>(strlen(key)));
+    }
+
+    /**
+     * LazyValue::findMember
+     *
+     * keys without escape sequences are compared in their encoded form,
+     * only escaped keys need to be decoded. All members are visited since the
+     * last one wins if a key appears more than once
+     */
+    LazyValue LazyValue::findMember(const char *key, int length) const {
+        if (type() != TypeObject) {
+            return LazyValue();
+        }
+        LazyValue result;
+        const std::vector<LazyDocument::Node> &nodes = m_Document->m_Nodes;
+        const char *data = m_Document->m_Data.constData();
+        int child = m_Node + 1;
+        for (int i = 0; i < nodes[m_Node].count; ++i) {
+            const LazyDocument::Node &keyNode = nodes[child];
+            if (keyNode.escaped) {
+                if (m_Document->decodeString(keyNode) == QString::fromUtf8(key, length)) {
+                    result = LazyValue(m_Document, child + 1);
+                }
+            } else if ((keyNode.end - keyNode.begin == length) &&
+                       (memcmp(data + keyNode.begin, key, length) == 0)) {
+                result = LazyValue(m_Document, child + 1);
+            }
+            child = nodes[child + 1].next;
+        }
+        return result;
+    }
+
+    QStringList LazyValue::keys() const {
+        QStringList result;
+        if (type() != TypeObject) {
+            return result;
+        }
+        const std::vector<LazyDocument::Node> &nodes = m_Document->m_Nodes;
+        int child = m_Node + 1;
+        for (int i = 0; i < nodes[m_Node].count; ++i) {
+            result.append(m_Document->decodeString(nodes[child]));
+            child = nodes[child + 1].next;
+        }
+        return result;
+    }
+
+    bool LazyValue::toBool() const {
+        return (type() == TypeBool) && (m_Document->m_Data.at(m_Document->m_Nodes[m_Node].begin) == 't');
+    }
+
+    int LazyValue::toInt() const {
+        return static_cast<int>(toLongLong());
+    }
+
+    qlonglong LazyValue::toLongLong() const {
+        if (type() != TypeNumber) {
+            return 0;
+        }
+        const LazyDocument::Node &node = m_Document->m_Nodes[m_Node];
+        QByteArray numberStr = QByteArray::fromRawData(m_Document->m_Data.constData() + node.begin, node.end - node.begin);
+        bool ok = false;
+        qlonglong result = numberStr.toLongLong(&ok);
+        if (!ok) {
+            result = static_cast<qlonglong>(numberStr.toDouble());
+        }
+        return result;
+    }
+
+    double LazyValue::toDouble() const {
+        if (type() != TypeNumber) {
+            return 0.0;
+        }
+        const LazyDocument::Node &node = m_Document->m_Nodes[m_Node];
+        return QByteArray::fromRawData(m_Document->m_Data.constData() + node.begin, node.end - node.begin).toDouble();
+    }
+
+    QString LazyValue::toString() const {
+        switch (type()) {
+            case TypeString: {
+                return m_Document->decodeString(m_Document->m_Nodes[m_Node]);
+            }
+            case TypeNumber:
+            case TypeBool: {
+                const LazyDocument::Node &node = m_Document->m_Nodes[m_Node];
+                return QString::fromLatin1(m_Document->m_Data.constData() + node.begin, node.end - node.begin);
+            }
+            default: {
+                return QString();
+            }
+        }
+    }
+
+    QVariant LazyValue::toVariant() const {
+        if (m_Document == nullptr) {
+            return QVariant();
+        }
+        return m_Document->toVariant(m_Node);
+    }
+
+
+    /**
+     * isWhitespace
+     */
+    static bool isWhitespace(char c) {
+        return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+    }
+
+    /**
+     * scanRecords
+     *
+     * Tracks nesting depth and string state only. In array mode records are the
+     * elements of the top level array, otherwise they are the top level values
+     * separated by line breaks
+     */
+    static bool scanRecords(const QByteArray &json, bool arrayMode, QVector<QPair<int, int> > &records) {
+        const char *data = json.constData();
+        const int size = json.size();
+        const int recordDepth = arrayMode ? 1 : 0;
+
+        int depth = 0;
+        int recordBegin = -1;
+        int pos = 0;
+        // a record is a single value, once that is complete only a separator may follow
+        bool valueComplete = false;
+        bool afterComma = false;
+
+        auto closeRecord = [&](int end) {
+            while ((end > recordBegin) && isWhitespace(data[end - 1])) {
+                --end;
+            }
+            records.append(qMakePair(recordBegin, end - recordBegin));
+            recordBegin = -1;
+        };
+
+        if (arrayMode) {
+            // skip to the opening bracket of the top level array
+            while (data[pos] != '[') {
+                ++pos;
+            }
+            ++pos;
+            depth = 1;
+        }
+
+        for (; pos < size; ++pos) {
+            char c = data[pos];
+            if ((recordBegin == -1) && (depth == recordDepth)) {
+                if (isWhitespace(c)) {
+                    continue;
+                } else if (arrayMode && (c == ']')) {
+                    if (afterComma) {
+                        // trailing comma
+                        return false;
+                    }
+                    // end of the top level array, only whitespace may follow
+                    for (++pos; pos < size; ++pos) {
+                        if (!isWhitespace(data[pos])) {
+                            return false;
+                        }
+                    }
+                    return true;
+                } else if ((c == ',') || (c == '}') || (c == ']')) {
+                    return false;
+                }
+                recordBegin = pos;
+                valueComplete = false;
+            } else if ((recordBegin != -1) && (depth == recordDepth)) {
+                if (isWhitespace(c)) {
+                    // ends a number or literal
+                    valueComplete = true;
+                } else if (valueComplete && !(arrayMode && ((c == ',') || (c == ']')))) {
+                    return false;
+                }
+            }
+
+            switch (c) {
+                case '"': {
+                    // skip over the string
+                    for (++pos; pos < size; ++pos) {
+                        const char *next = static_cast<const char*>(memchr(data + pos, '"', size - pos));
+                        if (next == nullptr) {
+                            return false;
+                        }
+                        int quote = static_cast<int>(next - data);
+                        // the quote is escaped if it's preceded by an odd number of backslashes
+                        int backslashes = 0;
+                        while ((quote - backslashes - 1 >= pos) && (data[quote - backslashes - 1] == '\\')) {
+                            ++backslashes;
+                        }
+                        pos = quote;
+                        if ((backslashes % 2) == 0) {
+                            break;
+                        }
+                    }
+                    if (pos >= size) {
+                        return false;
+                    }
+                    if (depth == recordDepth) {
+                        valueComplete = true;
+                    }
+                } break;
+                case '{':
+                case '[': {
+                    ++depth;
+                } break;
+                case '}':
+                case ']': {
+                    if (--depth < recordDepth) {
+                        if (!arrayMode || (recordBegin == -1)) {
+                            return false;
+                        }
+                        // closing bracket of the top level array directly after a record
+                        closeRecord(pos);
+                        afterComma = false;
+                        --pos;
+                        depth = recordDepth;
+                    } else if (depth == recordDepth) {
+                        valueComplete = true;
+                    }
+                } break;
+                case ',': {
+                    if (arrayMode && (depth == recordDepth)) {
+                        closeRecord(pos);
+                        afterComma = true;
+                    }
+                } break;
+                case '\n': {
+                    if (!arrayMode && (depth == recordDepth)) {
+                        closeRecord(pos);
+                    }
+                } break;
+            }
+        }
+
+        if (arrayMode || (depth != 0)) {
+            // unterminated array or record
+            return false;
+        }
+        if (recordBegin != -1) {
+            closeRecord(size);
+        }
+        return true;
+    }
+
+    QVector<QPair<int, int> > splitRecords(const QByteArray &json, bool &success) {
+        QVector<QPair<int, int> > records;
+
+        int pos = 0;
+        while ((pos < json.size()) && isWhitespace(json.at(pos))) {
+            ++pos;
+        }
+
+        // a line of ndjson may be an array itself so this is only treated as a
+        // single array if nothing follows it
+        success = (pos < json.size()) && (json.at(pos) == '[') && scanRecords(json, true, records);
+        if (!success) {
+            records.clear();
+            success = scanRecords(json, false, records);
+        }
+
+        if (!success) {
+            records.clear();
+        }
+        return records;
+    }
+
+    /**
+     * \class BulkParseJob
+     * \brief Parses a contiguous range of records, storing the results in place
+     */
+    class BulkParseJob : public QRunnable {
+    public:
+        BulkParseJob(const QByteArray &json, const QVector<QPair<int, int> > &records,
+                     int first, int last, QVariant *results, QAtomicInt &failed)
+            : m_Json(json), m_Records(records), m_First(first), m_Last(last)
+            , m_Results(results), m_Failed(failed) {}
+
+        virtual void run() {
+            LazyDocument document;
+            for (int i = m_First; (i < m_Last) && (m_Failed.load() == 0); ++i) {
+                const QPair<int, int> &record = m_Records.at(i);
+                // refers to the original data, the record isn't copied
+                if (!document.parse(QByteArray::fromRawData(m_Json.constData() + record.first, record.second))) {
+                    m_Failed.store(1);
+                    return;
+                }
+                m_Results[i] = document.root().toVariant();
+            }
+        }
+
+    private:
+        const QByteArray &m_Json;
+        const QVector<QPair<int, int> > &m_Records;
+        int m_First;
+        int m_Last;
+        QVariant *m_Results;
+        QAtomicInt &m_Failed;
+    };
+
+    QVariantList parseBulk(const QByteArray &json, bool &success, int maxThreads) {
+        QVector<QPair<int, int> > records = splitRecords(json, success);
+        if (!success) {
+            return QVariantList();
+        }
+
+        QVector<QVariant> results(records.size());
+        QAtomicInt failed(0);
+
+        if (maxThreads <= 0) {
+            maxThreads = QThread::idealThreadCount();
+        }
+        // below this, handing records to other threads costs more than it saves
+        static const int MinRecordsPerJob = 64;
+        int jobCount = std::min(maxThreads, records.size() / MinRecordsPerJob);
+
+        if (jobCount <= 1) {
+            BulkParseJob(json, records, 0, records.size(), results.data(), failed).run();
+        } else {
+            QThreadPool pool;
+            pool.setMaxThreadCount(jobCount);
+            // more jobs than threads so threads that finish early pick up remaining work
+            int jobs = jobCount * 4;
+            int perJob = (records.size() + jobs - 1) / jobs;
+            for (int first = 0; first < records.size(); first += perJob) {
+                int last = std::min(first + perJob, records.size());
+                pool.start(new BulkParseJob(json, records, first, last, results.data(), failed));
+            }
+            pool.waitForDone();
+        }
+
+        if (failed.load() != 0) {
+            success = false;
+            return QVariantList();
+        }
+        return results.toList();
+    }
 } //end namespace
@@ -25,6 +25,12 @@
 
 #include <QVariant>
 #include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+#include <vector>
+
+class QIODevice;
 
 
 /**
@@ -37,6 +43,15 @@ namespace QtJson {
     typedef QVariantMap JsonObject;
     typedef QVariantList JsonArray;
 
+    /**
+     * \enum SerializeStyle
+     * \brief Layout of the textual JSON representation
+     */
+    enum SerializeStyle {
+        StyleReadable, ///< separators are padded with spaces: "[ 1, 2 ]", "{ \"a\" : 1 }"
+        StyleCompact   ///< no whitespace between tokens: "[1,2]", "{\"a\":1}"
+    };
+
     /**
      * Parse a JSON string
      *
@@ -71,6 +86,30 @@ namespace QtJson {
      */
     QByteArray serialize(const QVariant &data, bool &success);
 
+    /**
+     * This method generates a textual JSON representation
+     *
+     * \param data The JSON data generated by the parser.
+     * \param success The success of the serialization
+     * \param style The layout of the generated text
+     *
+     * \return QByteArray Textual JSON representation in UTF-8
+     */
+    QByteArray serialize(const QVariant &data, bool &success, SerializeStyle style);
+
+    /**
+     * This method writes a textual JSON representation to a device. The text is
+     * written in blocks as it is generated so the full document is never held in memory
+     *
+     * \param data The JSON data generated by the parser.
+     * \param device The device to write to. It has to be open for writing
+     * \param style The layout of the generated text
+     *
+     * \return bool true if the data was serialized and written completely. If the data
+     *         can't be serialized, part of it may have been written to the device already
+     */
+    bool serialize(const QVariant &data, QIODevice *device, SerializeStyle style = StyleReadable);
+
     /**
      * This method generates a textual JSON representation
      *
@@ -89,6 +128,192 @@ namespace QtJson {
      * \return QString Textual JSON representation
      */
     QString serializeStr(const QVariant &data, bool &success);
+
+    /**
+     * Locate the records of a JSON array or of newline-delimited JSON without
+     * decoding them. Only the structure of the data is checked
+     *
+     * \param json Either a JSON array or one JSON value per line, encoded in UTF-8
+     * \param success The success of the scan
+     *
+     * \return QVector<QPair<int, int> > Offset and length of each record
+     */
+    QVector<QPair<int, int> > splitRecords(const QByteArray &json, bool &success);
+
+    /**
+     * Parse a bulk of JSON records on multiple threads
+     *
+     * \param json Either a JSON array or one JSON value per line, encoded in UTF-8
+     * \param success The success of the parsing. This fails if any of the records is invalid
+     * \param maxThreads Maximum number of threads to use. 0 uses one thread per core
+     *
+     * \return QVariantList The records in input order
+     */
+    QVariantList parseBulk(const QByteArray &json, bool &success, int maxThreads = 0);
+
+
+    class LazyDocument;
+
+    /**
+     * \class LazyValue
+     * \brief Reference to a value inside a LazyDocument
+     *
+     * Nothing is decoded until one of the conversion functions is called and
+     * only the referenced value (including its children) is materialized.
+     * A LazyValue is only valid as long as the document it was retrieved from.
+     */
+    class LazyValue {
+    public:
+        enum Type {
+            TypeInvalid = 0,
+            TypeNull,
+            TypeBool,
+            TypeNumber,
+            TypeString,
+            TypeArray,
+            TypeObject
+        };
+
+    public:
+        LazyValue() : m_Document(nullptr), m_Node(-1) {}
+
+        /**
+         * \return Type The type of the value or TypeInvalid if the value doesn't exist
+         */
+        Type type() const;
+
+        bool isValid() const { return m_Document != nullptr; }
+        bool isNull() const { return type() == TypeNull; }
+        bool isArray() const { return type() == TypeArray; }
+        bool isObject() const { return type() == TypeObject; }
+
+        /**
+         * \return int Number of elements of an array or members of an object, 0 otherwise
+         */
+        int size() const;
+
+        /**
+         * Retrieve an element of an array. This walks the preceding elements of the
+         * array without decoding them.
+         *
+         * \param index The index of the element
+         */
+        LazyValue at(int index) const;
+
+        /**
+         * Retrieve a member of an object
+         *
+         * \param key The name of the member
+         *
+         * \return LazyValue The member or an invalid value if there is no such member. If the
+         *         key appears more than once the last member is used, like QtJson::parse does
+         */
+        LazyValue value(const QString &key) const;
+
+        /**
+         * Retrieve a member of an object
+         *
+         * \param key The name of the member encoded in UTF-8
+         */
+        LazyValue value(const char *key) const;
+
+        bool contains(const QString &key) const { return value(key).isValid(); }
+
+        /**
+         * \return QStringList The names of all members of an object
+         */
+        QStringList keys() const;
+
+        bool toBool() const;
+        int toInt() const;
+        qlonglong toLongLong() const;
+        double toDouble() const;
+
+        /**
+         * \return QString The decoded string. For numbers this is their textual representation
+         */
+        QString toString() const;
+
+        /**
+         * Decode the value and all its children the way QtJson::parse would: numbers
+         * become doubles only if they contain a '.', integers that don't fit a 64 bit
+         * type (and numbers that only have an exponent) become strings, and the last
+         * member wins for duplicate keys
+         */
+        QVariant toVariant() const;
+
+    private:
+        friend class LazyDocument;
+
+        LazyValue(const LazyDocument *document, int node) : m_Document(document), m_Node(node) {}
+
+        LazyValue findMember(const char *key, int length) const;
+
+    private:
+        const LazyDocument *m_Document;
+        int m_Node;
+    };
+
+
+    /**
+     * \class LazyDocument
+     * \brief A JSON document that is only decoded on demand
+     *
+     * parse() scans the text once and records the location of every value. Objects,
+     * arrays and strings are only materialized when they are accessed through a
+     * LazyValue so skipping over parts of the document doesn't allocate anything.
+     */
+    class LazyDocument {
+    public:
+        LazyDocument() {}
+
+        /**
+         * Parse a JSON document
+         *
+         * \param json The JSON data encoded in UTF-8
+         */
+        explicit LazyDocument(const QByteArray &json) { parse(json); }
+
+        /**
+         * Parse a JSON document, replacing the previous content
+         *
+         * \param json The JSON data encoded in UTF-8. The data is shared, not copied
+         *
+         * \return bool The success of the parsing. Unlike QtJson::parse, which ignores
+         *         anything after the top level value, only whitespace may follow it
+         */
+        bool parse(const QByteArray &json);
+
+        bool isValid() const { return !m_Nodes.empty(); }
+
+        /**
+         * \return LazyValue The top level value or an invalid value if parsing failed
+         */
+        LazyValue root() const;
+
+    private:
+        friend class LazyValue;
+
+        struct Node {
+            int type;
+            bool escaped; ///< a string contains escape sequences
+            int begin;    ///< offset of the value, for strings the first character after the quote
+            int end;      ///< offset one past the value, for strings the closing quote
+            int next;     ///< index of the next node that is not a child of this one
+            int count;    ///< number of elements/members of a container
+        };
+
+        QString decodeString(const Node &node) const;
+        QVariant decodeNumber(const Node &node) const;
+        QVariant toVariant(int node) const;
+
+    private:
+        QByteArray m_Data;
+        std::vector<Node> m_Nodes;
+
+    private:
+        Q_DISABLE_COPY(LazyDocument)
+    };
 }
 
 #endif //JSON_H
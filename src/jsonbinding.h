@@ -0,0 +1,277 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef JSONBINDING_H
+#define JSONBINDING_H
+
+
+#include "json.h"
+#include <QString>
+#include <QList>
+#include <QVariant>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+
+namespace QtJson {
+
+
+/**
+ * @brief describes a field that couldn't be decoded
+ */
+struct BindingError {
+  QString field;
+  QString message;
+};
+
+typedef QList<BindingError> BindingErrors;
+
+
+/**
+ * @brief decode a json value into a variable of the matching type
+ * @return false if the value can't be converted to the target type. In that case
+ *         target is unchanged
+ * @note overload decodeField for your own types (in their namespace or in QtJson) to make
+ *       them usable as bound members
+ */
+inline bool decodeField(const LazyValue &value, QString &target)
+{
+  switch (value.type()) {
+    case LazyValue::TypeString:
+    case LazyValue::TypeNumber:
+    case LazyValue::TypeBool: {
+      target = value.toString();
+      return true;
+    } break;
+    default: {
+      return false;
+    } break;
+  }
+}
+
+inline bool decodeField(const LazyValue &value, bool &target)
+{
+  if (value.type() == LazyValue::TypeBool) {
+    target = value.toBool();
+    return true;
+  } else if (value.type() == LazyValue::TypeNumber) {
+    target = value.toLongLong() != 0;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value, bool>::type
+decodeField(const LazyValue &value, T &target)
+{
+  if (value.type() == LazyValue::TypeNumber) {
+    target = static_cast<T>(value.toLongLong());
+    return true;
+  } else if (value.type() == LazyValue::TypeString) {
+    bool ok = false;
+    qlonglong temp = value.toString().toLongLong(&ok);
+    if (ok) {
+      target = static_cast<T>(temp);
+    }
+    return ok;
+  } else {
+    return false;
+  }
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+decodeField(const LazyValue &value, T &target)
+{
+  if (value.type() == LazyValue::TypeNumber) {
+    target = static_cast<T>(value.toDouble());
+    return true;
+  } else if (value.type() == LazyValue::TypeString) {
+    bool ok = false;
+    double temp = value.toString().toDouble(&ok);
+    if (ok) {
+      target = static_cast<T>(temp);
+    }
+    return ok;
+  } else {
+    return false;
+  }
+}
+
+inline bool decodeField(const LazyValue &value, QVariantMap &target)
+{
+  if (!value.isObject()) {
+    return false;
+  }
+  target = value.toVariant().toMap();
+  return true;
+}
+
+inline bool decodeField(const LazyValue &value, QVariantList &target)
+{
+  if (!value.isArray()) {
+    return false;
+  }
+  target = value.toVariant().toList();
+  return true;
+}
+
+inline bool decodeField(const LazyValue &value, QVariant &target)
+{
+  target = value.toVariant();
+  return true;
+}
+
+
+/**
+ * @brief maps the fields of a json object or array onto the members of a struct
+ *
+ * The mapping is declared once per type, usually as a function-level static:
+ * @code
+ * static const QtJson::Binding<Foo> binding = QtJson::Binding<Foo>()
+ *     .field("id", &Foo::id)
+ *     .field("name", &Foo::name)
+ *     .field("version", [] (Foo &foo, const QtJson::LazyValue &value) {
+ *                         foo.version.parse(value.toString());
+ *                         return true;
+ *                       });
+ * @endcode
+ * Objects are matched by field name, arrays by the order in which fields were declared.
+ * Values are decoded from the json text straight into the members, without building an
+ * intermediate QVariant hierarchy. Fields that are missing or null keep their current value.
+ */
+template <typename T>
+class Binding {
+
+public:
+
+  typedef std::function<bool (T &target, const LazyValue &value)> Decoder;
+
+public:
+
+  /**
+   * @brief bind a field to a member
+   * @param name name of the field in json objects
+   * @param member the member to write to. There has to be a decodeField overload for its type
+   */
+  template <typename M>
+  Binding &field(const char *name, M T::*member)
+  {
+    m_Fields.push_back(Field(name, [member] (T &target, const LazyValue &value) -> bool {
+      return decodeField(value, target.*member);
+    }));
+    return *this;
+  }
+
+  /**
+   * @brief bind a field to a custom decoder
+   * @param name name of the field in json objects
+   * @param decoder function that stores the value in the target. Returns false if the value is invalid
+   */
+  Binding &field(const char *name, const Decoder &decoder)
+  {
+    m_Fields.push_back(Field(name, decoder));
+    return *this;
+  }
+
+  /**
+   * @brief decode a json value into target
+   * @param value the json object or array to decode
+   * @param target the struct to write to
+   * @param errors (optional) receives an entry for each field that could not be decoded
+   * @return true if all fields present in value were decoded successfully
+   */
+  bool decode(const LazyValue &value, T &target, BindingErrors *errors = nullptr) const
+  {
+    bool success = true;
+    if (value.isArray()) {
+      int count = std::min<int>(static_cast<int>(m_Fields.size()), value.size());
+      for (int i = 0; i < count; ++i) {
+        success = decodeOne(m_Fields[i], value.at(i), target, errors) && success;
+      }
+    } else if (value.isObject()) {
+      for (auto iter = m_Fields.begin(); iter != m_Fields.end(); ++iter) {
+        success = decodeOne(*iter, value.value(iter->name), target, errors) && success;
+      }
+    } else {
+      if (errors != nullptr) {
+        errors->append({ QString(), QString("expected an object or array") });
+      }
+      success = false;
+    }
+    return success;
+  }
+
+  /**
+   * @brief parse a json document and decode its top level value into target
+   * @param json json data encoded in utf-8
+   * @param target the struct to write to
+   * @param errors (optional) receives an entry for each field that could not be decoded
+   * @return true if the document was valid and all fields present were decoded successfully
+   */
+  bool decode(const QByteArray &json, T &target, BindingErrors *errors = nullptr) const
+  {
+    LazyDocument document;
+    if (!document.parse(json)) {
+      if (errors != nullptr) {
+        errors->append({ QString(), QString("invalid json") });
+      }
+      return false;
+    }
+    return decode(document.root(), target, errors);
+  }
+
+private:
+
+  struct Field {
+    Field(const char *name, const Decoder &decoder) : name(name), decoder(decoder) {}
+    const char *name;
+    Decoder decoder;
+  };
+
+private:
+
+  static bool decodeOne(const Field &field, const LazyValue &value, T &target, BindingErrors *errors)
+  {
+    if (!value.isValid() || value.isNull()) {
+      return true;
+    }
+    if (!field.decoder(target, value)) {
+      if (errors != nullptr) {
+        errors->append({ QString::fromUtf8(field.name), QString("unexpected value \"%1\"").arg(value.toString()) });
+      }
+      return false;
+    }
+    return true;
+  }
+
+private:
+
+  std::vector<Field> m_Fields;
+
+};
+
+} // namespace QtJson
+
+#endif // JSONBINDING_H
@@ -1,16 +1,9 @@
 #include "modrepositoryfileinfo.h"
 #include "json.h"
+#include "jsonbinding.h"
+#include <QDataStream>
 
 
-MOBase::ModRepositoryFileInfo::ModRepositoryFileInfo(const ModRepositoryFileInfo &reference)
-  : QObject(reference.parent()), name(reference.name), uri(reference.uri), description(reference.description),
-    version(reference.version), categoryID(reference.categoryID), modName(reference.modName),
-    modID(reference.modID), fileID(reference.fileID), fileSize(reference.fileSize),
-    fileCategory(reference.fileCategory),
-    repository(reference.repository), userData(reference.userData)
-{
-}
-
 MOBase::ModRepositoryFileInfo::ModRepositoryFileInfo(int modID, int fileID)
   : name(), uri(), description(), version(), categoryID(0), modName(), modID(modID), fileID(fileID),
     fileSize(0), fileCategory(TYPE_UNKNOWN), repository(), userData()
@@ -20,47 +13,191 @@ MOBase::ModRepositoryFileInfo::ModRepositoryFileInfo(int modID, int fileID)
 }
 
 
-MOBase::ModRepositoryFileInfo::ModRepositoryFileInfo(const QString &data)
+namespace {
+
+typedef MOBase::ModRepositoryFileInfo FileInfo;
+
+bool decodeVersion(MOBase::VersionInfo &target, const QtJson::LazyValue &value)
 {
-  QVariantList result = QtJson::parse(data).toList();
+  target.parse(value.toString());
+  return true;
+}
+
+// fields are stored positionally, in the order written by toString()
+const QtJson::Binding<FileInfo> &fileInfoBinding()
+{
+  static const QtJson::Binding<FileInfo> binding = QtJson::Binding<FileInfo>()
+      .field("fileID", &FileInfo::fileID)
+      .field("name", &FileInfo::name)
+      .field("uri", &FileInfo::uri)
+      .field("version", [] (FileInfo &info, const QtJson::LazyValue &value) {
+                          return decodeVersion(info.version, value); })
+      .field("description", &FileInfo::description)
+      .field("categoryID", &FileInfo::categoryID)
+      .field("fileSize", &FileInfo::fileSize)
+      .field("modID", &FileInfo::modID)
+      .field("modName", &FileInfo::modName)
+      .field("newestVersion", [] (FileInfo &info, const QtJson::LazyValue &value) {
+                                return decodeVersion(info.newestVersion, value); })
+      .field("fileName", &FileInfo::fileName)
+      .field("fileCategory", &FileInfo::fileCategory)
+      .field("repository", &FileInfo::repository)
+      .field("userData", &FileInfo::userData);
+  return binding;
+}
+
+}
+
 
-  while (result.length() < 14) {
-    result.append(QVariant());
+MOBase::ModRepositoryFileInfo::ModRepositoryFileInfo(const QString &data)
+  : name(), uri(), description(), version(), categoryID(0), modName(), modID(0), fileID(0),
+    fileSize(0), fileCategory(TYPE_UNKNOWN), repository(), userData()
+{
+  QtJson::BindingErrors errors;
+  if (!data.isEmpty() && !fileInfoBinding().decode(data.toUtf8(), *this, &errors)) {
+    foreach (const QtJson::BindingError &error, errors) {
+      qWarning("invalid file info field \"%s\": %s",
+               qPrintable(error.field), qPrintable(error.message));
+    }
   }
-  fileID      = result.at(0).toInt();
-  name        = result.at(1).toString();
-  uri         = result.at(2).toString();
-  version.parse(result.at(3).toString());
-  description = result.at(4).toString();
-  categoryID  = result.at(5).toInt();
-  fileSize    = result.at(6).toInt();
-  modID       = result.at(7).toInt();
-  modName     = result.at(8).toString();
-
-  newestVersion.parse(result.at(9).toString());
-  fileName     = result.at(10).toString();
-  fileCategory = result.at(11).toInt();
-  repository   = result.at(12).toString();
-
-  userData = result.at(13).toMap();
 }
 
 
 QString MOBase::ModRepositoryFileInfo::toString() const
 {
-  return QString("[ %1,\"%2\",\"%3\",\"%4\",\"%5\",%6,%7,%8,\"%9\",\"%10\",\"%11\",%12,\"%13\", %14 ]")
-            .arg(fileID)
-            .arg(name)
-            .arg(uri)
-            .arg(version.canonicalString())
-            .arg(description.mid(0).replace("\"", "'"))
-            .arg(categoryID)
-            .arg(fileSize)
-            .arg(modID)
-            .arg(modName)
-            .arg(newestVersion.canonicalString())
-            .arg(fileName)
-            .arg(fileCategory)
-            .arg(repository)
-            .arg(QString(QtJson::serialize(userData)));
+  QVariantList fields;
+  fields << fileID
+         << name
+         << uri
+         << version.canonicalString()
+         << description
+         << categoryID
+         << static_cast<qulonglong>(fileSize)
+         << modID
+         << modName
+         << newestVersion.canonicalString()
+         << fileName
+         << fileCategory
+         << repository
+         << userData;
+  return QtJson::serializeStr(fields);
+}
+
+
+namespace {
+
+// "MRFI"
+const quint32 BINARY_MAGIC = 0x4D524649;
+const quint16 BINARY_VERSION = 1;
+// smallest possible size of an encoded record, used to validate the record count
+const int MIN_RECORD_SIZE = 64;
+
+}
+
+
+QDataStream &MOBase::operator<<(QDataStream &stream, const ModRepositoryFileInfo &info)
+{
+  stream << static_cast<qint32>(info.fileID)
+         << info.name
+         << info.uri
+         << info.version.canonicalString()
+         << info.description
+         << static_cast<qint32>(info.categoryID)
+         << static_cast<quint64>(info.fileSize)
+         << static_cast<qint32>(info.modID)
+         << info.modName
+         << info.newestVersion.canonicalString()
+         << info.fileName
+         << static_cast<qint32>(info.fileCategory)
+         << info.fileTime
+         << info.repository
+         << info.userData;
+  return stream;
+}
+
+
+QDataStream &MOBase::operator>>(QDataStream &stream, ModRepositoryFileInfo &info)
+{
+  qint32 fileID, categoryID, modID, fileCategory;
+  quint64 fileSize;
+  QString version, newestVersion;
+
+  stream >> fileID
+         >> info.name
+         >> info.uri
+         >> version
+         >> info.description
+         >> categoryID
+         >> fileSize
+         >> modID
+         >> info.modName
+         >> newestVersion
+         >> info.fileName
+         >> fileCategory
+         >> info.fileTime
+         >> info.repository
+         >> info.userData;
+
+  info.fileID = fileID;
+  info.version.parse(version);
+  info.categoryID = categoryID;
+  info.fileSize = static_cast<size_t>(fileSize);
+  info.modID = modID;
+  info.newestVersion.parse(newestVersion);
+  info.fileCategory = fileCategory;
+  return stream;
+}
+
+
+QByteArray MOBase::ModRepositoryFileInfo::encodeList(const QList<ModRepositoryFileInfo> &files)
+{
+  QByteArray result;
+  result.reserve(files.size() * 256);
+
+  QDataStream stream(&result, QIODevice::WriteOnly);
+  // fixed so the encoding doesn't change with the qt version
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream << BINARY_MAGIC << BINARY_VERSION << static_cast<quint32>(files.size());
+  foreach (const ModRepositoryFileInfo &info, files) {
+    stream << info;
+  }
+  return result;
+}
+
+
+QList<MOBase::ModRepositoryFileInfo> MOBase::ModRepositoryFileInfo::decodeList(const QByteArray &data, bool *ok)
+{
+  QList<ModRepositoryFileInfo> result;
+  if (ok != nullptr) {
+    *ok = false;
+  }
+
+  QDataStream stream(data);
+  stream.setVersion(QDataStream::Qt_5_0);
+
+  quint32 magic;
+  quint16 version;
+  quint32 count;
+  stream >> magic >> version >> count;
+  if ((stream.status() != QDataStream::Ok)
+      || (magic != BINARY_MAGIC)
+      || (version > BINARY_VERSION)
+      || (count > static_cast<quint32>(data.size() / MIN_RECORD_SIZE) + 1)) {
+    return result;
+  }
+
+  result.reserve(static_cast<int>(count));
+  for (quint32 i = 0; i < count; ++i) {
+    ModRepositoryFileInfo info;
+    stream >> info;
+    if (stream.status() != QDataStream::Ok) {
+      return QList<ModRepositoryFileInfo>();
+    }
+    result.append(info);
+  }
+
+  if (ok != nullptr) {
+    *ok = true;
+  }
+  return result;
 }
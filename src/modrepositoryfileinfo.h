@@ -5,6 +5,11 @@
 #include <QString>
 #include <QDateTime>
 #include <QVariantMap>
+#include <QList>
+#include <QByteArray>
+#include <QMetaType>
+
+class QDataStream;
 
 namespace MOBase {
   enum EFileCategory {
@@ -14,16 +19,36 @@ namespace MOBase {
     TYPE_OPTION
   };
 
-  class QDLLEXPORT ModRepositoryFileInfo : public QObject {
-    Q_OBJECT
+  /**
+   * @brief information about a file in a mod repository
+   * @note this is a plain value type. Lists of file infos are implicitly shared so
+   *       passing them through (queued) signals only costs a reference count increment
+   */
+  class QDLLEXPORT ModRepositoryFileInfo {
 
   public:
 
-    ModRepositoryFileInfo(const ModRepositoryFileInfo &reference);
     ModRepositoryFileInfo(int modID = 0, int fileID = 0);
     ModRepositoryFileInfo(const QString &data);
     QString toString() const;
 
+    /**
+     * @brief encode a list of file infos in a compact, versioned binary format. Unlike
+     *        toString() this is lossless
+     * @param files the file infos to encode
+     * @return the encoded data
+     */
+    static QByteArray encodeList(const QList<ModRepositoryFileInfo> &files);
+
+    /**
+     * @brief decode a list of file infos encoded with encodeList
+     * @param data the encoded data
+     * @param ok (optional) receives false if the data isn't a valid encoding or was
+     *           written by a newer version
+     * @return the decoded file infos. Empty if the data is invalid
+     */
+    static QList<ModRepositoryFileInfo> decodeList(const QByteArray &data, bool *ok = nullptr);
+
     QString name;
     QString uri;
     QString description;
@@ -41,6 +66,19 @@ namespace MOBase {
 
     QVariantMap userData;
   };
+
+  /**
+   * @brief write a single file info to a binary stream, without the header written by encodeList
+   */
+  QDLLEXPORT QDataStream &operator<<(QDataStream &stream, const ModRepositoryFileInfo &info);
+
+  /**
+   * @brief read a single file info written with operator<<
+   */
+  QDLLEXPORT QDataStream &operator>>(QDataStream &stream, ModRepositoryFileInfo &info);
 }
 
+Q_DECLARE_TYPEINFO(MOBase::ModRepositoryFileInfo, Q_MOVABLE_TYPE);
+Q_DECLARE_METATYPE(MOBase::ModRepositoryFileInfo)
+
 #endif // MODREPOSITORYFILEINFO_H
@@ -19,17 +19,209 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "nxmurl.h"
 #include "utility.h"
-#include <QRegExp>
-#include <QStringList>
+#include <QSet>
+#include <QUrl>
+#include <limits>
+
+
+namespace {
+
+/**
+ * identifies the file a link refers to. The game name is shared with the link, not copied,
+ * and compared case-insensitively
+ */
+struct LinkIdentity {
+  QString game;
+  int modId;
+  int fileId;
+
+  bool operator==(const LinkIdentity &other) const
+  {
+    return (modId == other.modId) && (fileId == other.fileId)
+        && (game.compare(other.game, Qt::CaseInsensitive) == 0);
+  }
+};
+
+uint qHash(const LinkIdentity &identity)
+{
+  uint result = ::qHash(identity.modId) ^ (::qHash(identity.fileId) * 31);
+  const QChar *data = identity.game.constData();
+  for (int i = 0; i < identity.game.size(); ++i) {
+    result = result * 31 + data[i].toCaseFolded().unicode();
+  }
+  return result;
+}
+
+bool isAlphaNum(QChar c)
+{
+  ushort u = c.unicode();
+  return ((u >= '0') && (u <= '9'))
+      || ((u >= 'a') && (u <= 'z'))
+      || ((u >= 'A') && (u <= 'Z'));
+}
+
+// parse an unsigned decimal number starting at pos. pos is moved past the digits
+template <typename T>
+bool parseNumber(const QChar *data, int size, int &pos, T &result)
+{
+  int begin = pos;
+  T value = 0;
+  for (; (pos < size) && (data[pos] >= QLatin1Char('0')) && (data[pos] <= QLatin1Char('9')); ++pos) {
+    T digit = data[pos].unicode() - '0';
+    if (value > (std::numeric_limits<T>::max() - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
+  }
+  result = value;
+  return pos != begin;
+}
+
+// match a literal (case-insensitive) at pos, moving pos past it on success
+bool matchLiteral(const QChar *data, int size, int &pos, const char *literal)
+{
+  int i = pos;
+  for (; *literal != '\0'; ++literal, ++i) {
+    if ((i >= size) || (data[i].toLower().unicode() != static_cast<ushort>(*literal))) {
+      return false;
+    }
+  }
+  pos = i;
+  return true;
+}
+
+NXMUrl::ParseStatus parseQuery(const QString &url, int pos, NXMUrl::Link &link)
+{
+  const QChar *data = url.constData();
+  const int size = url.size();
+
+  while (pos < size) {
+    int nameBegin = pos;
+    while ((pos < size) && (data[pos] != QLatin1Char('=')) && (data[pos] != QLatin1Char('&'))) {
+      ++pos;
+    }
+    QStringRef name(&url, nameBegin, pos - nameBegin);
+    int valueBegin = pos;
+    int valueEnd = pos;
+    if ((pos < size) && (data[pos] == QLatin1Char('='))) {
+      valueBegin = ++pos;
+      while ((pos < size) && (data[pos] != QLatin1Char('&'))) {
+        ++pos;
+      }
+      valueEnd = pos;
+    }
+
+    if (name == QLatin1String("key")) {
+      QStringRef value(&url, valueBegin, valueEnd - valueBegin);
+      if (value.contains(QLatin1Char('%'))) {
+        link.key = QUrl::fromPercentEncoding(value.toUtf8());
+      } else {
+        link.key = value.toString();
+      }
+    } else if (name == QLatin1String("expires")) {
+      int numberPos = valueBegin;
+      if (!parseNumber(data, valueEnd, numberPos, link.expires) || (numberPos != valueEnd)) {
+        return NXMUrl::ParseStatus::INVALID_QUERY;
+      }
+    } else if (name == QLatin1String("user_id")) {
+      int numberPos = valueBegin;
+      if (!parseNumber(data, valueEnd, numberPos, link.userId) || (numberPos != valueEnd)) {
+        return NXMUrl::ParseStatus::INVALID_QUERY;
+      }
+    }
+    // unknown parameters are ignored
+
+    if (pos < size) {
+      // skip the '&'
+      ++pos;
+    }
+  }
+  return NXMUrl::ParseStatus::OK;
+}
+
+}
+
 
 NXMUrl::NXMUrl(const QString &url)
 {
-  QRegExp exp("nxm://([a-z0-9]+)/mods/(\\d+)/files/(\\d+)", Qt::CaseInsensitive);
-  exp.indexIn(url);
-  if (exp.captureCount() != 3) {
+  if (parse(url, m_Link) != ParseStatus::OK) {
     throw MOBase::MyException(tr("invalid nxm-link: %1").arg(url));
   }
-  m_Game = exp.cap(1);
-  m_ModId = exp.cap(2).toInt();
-  m_FileId = exp.cap(3).toInt();
+}
+
+NXMUrl::ParseStatus NXMUrl::parse(const QString &url, Link &link)
+{
+  const QChar *data = url.constData();
+  const int size = url.size();
+
+  // the link may be embedded in other text, i.e. quoted on the command line
+  int pos = url.indexOf(QLatin1String("nxm://"), 0, Qt::CaseInsensitive);
+  if (pos == -1) {
+    return ParseStatus::INVALID_SCHEME;
+  }
+  pos += 6;
+
+  int gameBegin = pos;
+  while ((pos < size) && isAlphaNum(data[pos])) {
+    ++pos;
+  }
+  if ((pos == gameBegin) || ((pos < size) && (data[pos] != QLatin1Char('/')))) {
+    return ParseStatus::INVALID_GAME;
+  }
+  int gameEnd = pos;
+
+  if (!matchLiteral(data, size, pos, "/mods/")) {
+    return ParseStatus::INVALID_PATH;
+  }
+  int modId = 0;
+  if (!parseNumber(data, size, pos, modId)) {
+    return ParseStatus::INVALID_MODID;
+  }
+  if (!matchLiteral(data, size, pos, "/files/")) {
+    return ParseStatus::INVALID_PATH;
+  }
+  int fileId = 0;
+  if (!parseNumber(data, size, pos, fileId)) {
+    return ParseStatus::INVALID_FILEID;
+  }
+
+  Link result;
+  // anything following the file id other than a query is ignored
+  int query = url.indexOf(QLatin1Char('?'), pos);
+  if (query != -1) {
+    ParseStatus status = parseQuery(url, query + 1, result);
+    if (status != ParseStatus::OK) {
+      return status;
+    }
+  }
+
+  result.game = url.mid(gameBegin, gameEnd - gameBegin);
+  result.modId = modId;
+  result.fileId = fileId;
+  link = result;
+  return ParseStatus::OK;
+}
+
+QList<NXMUrl::Link> NXMUrl::parseAll(const QStringList &urls, QStringList *invalidUrls)
+{
+  QList<Link> result;
+  result.reserve(urls.size());
+  QSet<LinkIdentity> seen;
+  seen.reserve(urls.size());
+
+  Link link;
+  foreach (const QString &url, urls) {
+    if (parse(url, link) != ParseStatus::OK) {
+      if (invalidUrls != nullptr) {
+        invalidUrls->append(url);
+      }
+      continue;
+    }
+    LinkIdentity identity = { link.game, link.modId, link.fileId };
+    if (!seen.contains(identity)) {
+      seen.insert(identity);
+      result.append(link);
+    }
+  }
+  return result;
 }
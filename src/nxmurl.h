@@ -21,6 +21,8 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #define NXMURL_H
 
 #include <QString>
+#include <QStringList>
+#include <QList>
 #include <QObject>
 #include "dllimport.h"
 
@@ -33,39 +35,96 @@ class QDLLEXPORT NXMUrl : public QObject
 {
   Q_OBJECT
 
+public:
+
+  enum class ParseStatus {
+    OK,
+    INVALID_SCHEME,   // no "nxm://" prefix
+    INVALID_GAME,     // game name missing or contains invalid characters
+    INVALID_PATH,     // not of the form <game>/mods/<id>/files/<id>
+    INVALID_MODID,
+    INVALID_FILEID,
+    INVALID_QUERY     // a known query parameter has an invalid value
+  };
+
+  /**
+   * @brief the content of a nxm link
+   */
+  struct Link {
+    Link() : modId(0), fileId(0), expires(0), userId(0) {}
+
+    QString game;
+    int modId;
+    int fileId;
+    QString key;     // download key, empty if the link has none
+    qint64 expires;  // expiry time of the key in seconds since epoch, 0 if the link has none
+    int userId;      // id of the user the key was issued for, 0 if the link has none
+  };
+
 public:
 
   /**
    * @brief constructor
    *
    * @param url url following the nxm-protocol
+   * @throw MyException if the url is not a valid nxm link
    **/
   NXMUrl(const QString &url);
 
+  /**
+   * @brief parse a nxm link without throwing
+   * @param url url following the nxm-protocol
+   * @param link receives the content of the link. Only valid if the result is ParseStatus::OK
+   * @return status of the parse
+   */
+  static ParseStatus parse(const QString &url, Link &link);
+
+  /**
+   * @brief parse a list of nxm links, dropping invalid links and duplicates
+   * @param urls the urls to parse
+   * @param invalidUrls (optional) receives the urls that couldn't be parsed
+   * @return the valid links in the order they first appear in urls. Links are considered
+   *         duplicates if they refer to the same file of the same game
+   */
+  static QList<Link> parseAll(const QStringList &urls, QStringList *invalidUrls = nullptr);
+
   /**
    * @return name of the game
    */
-  QString game() const { return m_Game; }
+  QString game() const { return m_Link.game; }
 
   /**
    * @brief retrieve the mod id encoded into the url
    *
    * @return mod id
    **/
-  int modId() const { return m_ModId; }
+  int modId() const { return m_Link.modId; }
 
   /**
    * @brief retrieve the file id encoded into the url
    *
    * @return file id
    **/
-  int fileId() const { return m_FileId; }
+  int fileId() const { return m_Link.fileId; }
+
+  /**
+   * @return download key encoded into the url or an empty string if there is none
+   */
+  QString key() const { return m_Link.key; }
+
+  /**
+   * @return expiry time of the download key in seconds since epoch or 0 if there is none
+   */
+  qint64 expires() const { return m_Link.expires; }
+
+  /**
+   * @return id of the user the download key was issued for or 0 if there is none
+   */
+  int userId() const { return m_Link.userId; }
 
 private:
 
-  QString m_Game;
-  int m_ModId;
-  int m_FileId;
+  Link m_Link;
 };
 
 #endif // NXMURL_H
@@ -26,15 +26,36 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <QPushButton>
 #include <QMutex>                  // for QMutex
 #include <QMutexLocker>
+#include <QReadWriteLock>
+#include <QRunnable>
 #include <QSettings>
 #include <QStyle>                  // for QStyle, etc
+#include <QThreadPool>
 
+#include <functional>
 #include <stdlib.h>                // for atexit
 
 namespace MOBase {
 
 QSettings *QuestionBoxMemory::s_SettingFile = nullptr;
 QMutex QuestionBoxMemory::s_SettingsMutex;
+QList<QPair<QString, QVariant>> QuestionBoxMemory::s_PendingChanges;
+bool QuestionBoxMemory::s_PersistScheduled = false;
+QReadWriteLock QuestionBoxMemory::s_ChoicesLock;
+QHash<QString, int> QuestionBoxMemory::s_Choices;
+
+
+namespace {
+
+class PersistJob : public QRunnable {
+public:
+  PersistJob(std::function<void()> func) : m_Func(func) {}
+  virtual void run() override { m_Func(); }
+private:
+  std::function<void()> m_Func;
+};
+
+}
 
 QuestionBoxMemory::QuestionBoxMemory(QWidget *parent, const QString &title, const QString &text, QString const *filename,
                                      const QDialogButtonBox::StandardButtons buttons, QDialogButtonBox::StandardButton defaultButton)
@@ -77,19 +98,92 @@ void QuestionBoxMemory::init(const QString &fileName)
   if (s_SettingFile == nullptr) {
     s_SettingFile = new QSettings(fileName, QSettings::IniFormat);
     atexit(&QuestionBoxMemory::cleanup);
+
+    // all choices are kept in memory so queries don't have to go through QSettings
+    QWriteLocker choicesLocker(&s_ChoicesLock);
+    s_SettingFile->beginGroup("DialogChoices");
+    foreach (const QString &key, s_SettingFile->allKeys()) {
+      s_Choices[normalizedKey(key)] = s_SettingFile->value(key).toInt();
+    }
+    s_SettingFile->endGroup();
   }
 }
 
 void QuestionBoxMemory::resetDialogs()
 {
-  s_SettingFile->remove("DialogChoices");
+  {
+    QWriteLocker locker(&s_ChoicesLock);
+    s_Choices.clear();
+  }
+  schedulePersist(QString(), QVariant());
 }
 
 void QuestionBoxMemory::cleanup()
 {
+  persist();
   QMutexLocker locker(&s_SettingsMutex);
-  s_SettingFile->sync();
   delete s_SettingFile;
+  s_SettingFile = nullptr;
+}
+
+QString QuestionBoxMemory::normalizedKey(const QString &key)
+{
+  // compare keys the way QSettings does, so they match after a restart. Ini files are
+  // case insensitive on windows
+#ifdef Q_OS_WIN
+  QString result = key.toLower();
+#else
+  QString result = key;
+#endif
+  result.replace('\\', '/');
+  while (result.contains("//")) {
+    result.replace("//", "/");
+  }
+  while (result.startsWith('/')) {
+    result.remove(0, 1);
+  }
+  while (result.endsWith('/')) {
+    result.chop(1);
+  }
+  return result;
+}
+
+void QuestionBoxMemory::setChoice(const QString &key, QDialogButtonBox::StandardButton button)
+{
+  {
+    QWriteLocker locker(&s_ChoicesLock);
+    s_Choices[key] = button;
+  }
+  schedulePersist(key, static_cast<int>(button));
+}
+
+void QuestionBoxMemory::schedulePersist(const QString &key, const QVariant &value)
+{
+  QMutexLocker locker(&s_SettingsMutex);
+  s_PendingChanges.append(qMakePair(key, value));
+  if (!s_PersistScheduled) {
+    s_PersistScheduled = true;
+    QThreadPool::globalInstance()->start(new PersistJob(&QuestionBoxMemory::persist));
+  }
+}
+
+void QuestionBoxMemory::persist()
+{
+  QMutexLocker locker(&s_SettingsMutex);
+  s_PersistScheduled = false;
+  if ((s_SettingFile == nullptr) || s_PendingChanges.isEmpty()) {
+    return;
+  }
+  for (const QPair<QString, QVariant> &change : s_PendingChanges) {
+    QString key = change.first.isEmpty() ? QString("DialogChoices") : "DialogChoices/" + change.first;
+    if (change.second.isValid()) {
+      s_SettingFile->setValue(key, change.second);
+    } else {
+      s_SettingFile->remove(key);
+    }
+  }
+  s_PendingChanges.clear();
+  s_SettingFile->sync();
 }
 
 void QuestionBoxMemory::buttonClicked(QAbstractButton *button)
@@ -115,30 +209,35 @@ QDialogButtonBox::StandardButton QuestionBoxMemory::queryImpl(QWidget *parent, c
     const QString &title, const QString &text, QDialogButtonBox::StandardButtons buttons,
     QDialogButtonBox::StandardButton defaultButton)
 {
-  QMutexLocker locker(&s_SettingsMutex);
-  QString windowSetting("DialogChoices/" + windowName);
+  QString windowSetting = normalizedKey(windowName);
   QString fileSetting;
-  if (fileName != nullptr) {
-    fileSetting = windowSetting + "/" + *fileName;
-    if (s_SettingFile->contains(fileSetting)) {
-      return static_cast<QDialogButtonBox::StandardButton>(s_SettingFile->value(fileSetting).toInt());
+  {
+    QReadLocker locker(&s_ChoicesLock);
+    if (fileName != nullptr) {
+      fileSetting = normalizedKey(windowName + "/" + *fileName);
+      auto iter = s_Choices.find(fileSetting);
+      if (iter != s_Choices.end()) {
+        return static_cast<QDialogButtonBox::StandardButton>(*iter);
+      }
+    }
+    auto iter = s_Choices.find(windowSetting);
+    if (iter != s_Choices.end()) {
+      return static_cast<QDialogButtonBox::StandardButton>(*iter);
     }
   }
-  if (s_SettingFile->contains(windowSetting)) {
-    return static_cast<QDialogButtonBox::StandardButton>(s_SettingFile->value(windowSetting).toInt());
-  }
+
+  // no lock is held while the dialog is open so other threads can still get remembered choices
   QuestionBoxMemory dialog(parent, title, text, fileName, buttons, defaultButton);
   dialog.exec();
   if (dialog.m_Button != QDialogButtonBox::Cancel) {
     if (dialog.ui->rememberCheckBox->isChecked()) {
-      s_SettingFile->setValue(windowSetting, dialog.m_Button);
+      setChoice(windowSetting, dialog.m_Button);
     }
     if (fileName != nullptr && dialog.ui->rememberForCheckBox->isChecked()) {
-      s_SettingFile->setValue(fileSetting, dialog.m_Button);
+      setChoice(fileSetting, dialog.m_Button);
     }
   }
   return dialog.m_Button;
 }
 
 }
-
@@ -25,11 +25,16 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include <QDialog>
 #include <QDialogButtonBox>
+#include <QHash>
+#include <QList>
 #include <QObject>
+#include <QPair>
 #include <QString>
+#include <QVariant>
 
 class QAbstractButton;
 class QMutex;
+class QReadWriteLock;
 class QSettings;
 class QWidget;
 
@@ -74,10 +79,24 @@ private:
 
   static void cleanup();
 
+  static QString normalizedKey(const QString &key);
+  static void setChoice(const QString &key, QDialogButtonBox::StandardButton button);
+  static void schedulePersist(const QString &key, const QVariant &value);
+  static void persist();
+
 private:
 
+  // protects the settings file and the list of changes not yet written to it
   static QMutex s_SettingsMutex;
   static QSettings *s_SettingFile;
+  // changes to be written to the settings file. An invalid value removes the key
+  static QList<QPair<QString, QVariant>> s_PendingChanges;
+  static bool s_PersistScheduled;
+
+  // remembered choices by window name or window name and file name, relative to
+  // the DialogChoices group of the settings file
+  static QReadWriteLock s_ChoicesLock;
+  static QHash<QString, int> s_Choices;
 
   static QDialogButtonBox::StandardButton queryImpl(QWidget *parent, const QString &windowName, const QString *fileName,
                                                 const QString &title, const QString &text,
@@ -1,112 +1,430 @@
 #include "taskprogressmanager.h"
 #include <QApplication>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
 #include <QWidget>
 #include <QMainWindow>
 
+#ifdef Q_OS_WIN
+#include <Windows.h>
+#include <shobjidl.h>
+#endif
+
 namespace MOBase {
 
+
+// time constant (in milliseconds) of the exponential smoothing of throughput
+static const double ThroughputSmoothing = 3000.0;
+
+static qint64 estimateRemaining(qint64 value, qint64 max, double throughput)
+{
+  if ((throughput <= 0.0) || (value >= max)) {
+    return -1;
+  }
+  return static_cast<qint64>(static_cast<double>(max - value) * 1000.0 / throughput);
+}
+
+
+#ifdef Q_OS_WIN
+
+namespace {
+
+/**
+ * displays progress on the taskbar button of the main window
+ */
+class TaskbarSink : public ITaskProgressSink
+{
+public:
+  TaskbarSink(HWND window, ITaskbarList3 *taskbar)
+    : m_Window(window), m_Taskbar(taskbar), m_Active(false)
+  {
+  }
+
+  // the taskbar is not released, the sink lives until the process exits and by
+  // then COM may already be gone
+
+  virtual void setProgress(qint64 completed, qint64 total) override
+  {
+    if (!m_Active) {
+      m_Taskbar->SetProgressState(m_Window, TBPF_NORMAL);
+      m_Active = true;
+    }
+    m_Taskbar->SetProgressValue(m_Window, completed, total);
+  }
+
+  virtual void clearProgress() override
+  {
+    m_Taskbar->SetProgressState(m_Window, TBPF_NOPROGRESS);
+    m_Active = false;
+  }
+
+private:
+  HWND m_Window;
+  ITaskbarList3 *m_Taskbar;
+  bool m_Active;
+};
+
+}
+
+#endif // Q_OS_WIN
+
+
 TaskProgressManager &TaskProgressManager::instance()
 {
   static TaskProgressManager s_Instance;
+  static bool s_Moved = [] {
+    // the timer and the sink have to be used on the gui thread, no matter which thread
+    // reported progress first
+    QCoreApplication *application = QCoreApplication::instance();
+    if (application != nullptr) {
+      s_Instance.moveToThread(application->thread());
+      return true;
+    }
+    qWarning("task progress manager created without an application object");
+    return false;
+  }();
+  Q_UNUSED(s_Moved);
   return s_Instance;
 }
 
 void TaskProgressManager::forgetMe(quint32 id)
 {
-  if (m_Taskbar == nullptr) {
-    return;
-  }
-  auto iter = m_Percentages.find(id);
-  if (iter != m_Percentages.end()) {
-    m_Percentages.erase(iter);
+  Slot *slot = findSlot(id, false);
+  if (slot != nullptr) {
+    releaseSlot(*slot);
+    if (!m_TimerActive.exchange(true)) {
+      QMetaObject::invokeMethod(this, "activate", Qt::QueuedConnection);
+    }
   }
-  showProgress();
 }
 
 void TaskProgressManager::updateProgress(quint32 id, qint64 value, qint64 max)
 {
-  QMutexLocker lock(&m_Mutex);
-  if (m_Taskbar == nullptr) {
+  // tasks are tracked even without a sink, their status is available through the query
+  // functions and signals
+  Slot *slot = findSlot(id, value < max);
+  if (slot == nullptr) {
     return;
   }
 
-  if (value == max) {
-    auto iter = m_Percentages.find(id);
-    if (iter != m_Percentages.end()) {
-      m_Percentages.erase(iter);
-    }
+  slot->value.store(value, std::memory_order_relaxed);
+  slot->max.store(max, std::memory_order_relaxed);
+  if (value >= max) {
+    releaseSlot(*slot);
   } else {
-    m_Percentages[id] = std::make_pair(QTime::currentTime(), (value * 100) / max);
+    slot->sequence.fetch_add(1, std::memory_order_release);
   }
 
-  showProgress();
+  // the timer can only be started on the main thread
+  if (!m_TimerActive.exchange(true)) {
+    QMetaObject::invokeMethod(this, "activate", Qt::QueuedConnection);
+  }
 }
 
 quint32 TaskProgressManager::getId()
 {
-  QMutexLocker lock(&m_Mutex);
   return m_NextId++;
 }
 
+void TaskProgressManager::setSink(ITaskProgressSink *sink)
+{
+  m_Sink.reset(sink);
+  m_ShownCompleted = 0;
+  m_ShownTotal = 0;
+}
 
-void TaskProgressManager::showProgress()
+TaskProgressManager::Slot *TaskProgressManager::findSlot(quint32 id, bool create)
 {
-  if (!m_Percentages.empty()) {
-    m_Taskbar->SetProgressState(m_WinId, TBPF_NORMAL);
+  for (Slot &slot : m_Slots) {
+    if (slot.id.load(std::memory_order_acquire) == id) {
+      return &slot;
+    }
+  }
+  if (!create) {
+    return nullptr;
+  }
+
+  // only the first update of a task gets here. Claims are serialized so a task reported
+  // by two threads at the same time still gets only one slot
+  while (m_Claiming.test_and_set(std::memory_order_acquire)) {
+    QThread::yieldCurrentThread();
+  }
+  Slot *result = nullptr;
+  for (Slot &slot : m_Slots) {
+    if (slot.id.load(std::memory_order_acquire) == id) {
+      result = &slot;
+      break;
+    }
+  }
+  if (result == nullptr) {
+    for (Slot &slot : m_Slots) {
+      quint32 expected = 0;
+      if (slot.claim.compare_exchange_strong(expected, id)) {
+        // the values of the previous task must not be taken for the first sample of this one
+        slot.value.store(0);
+        slot.max.store(0);
+        slot.id.store(id, std::memory_order_release);
+        result = &slot;
+        break;
+      }
+    }
+  }
+  m_Claiming.clear(std::memory_order_release);
+  return result;
+}
 
-    QTime now = QTime::currentTime();
-    qint64 total = 0;
-    int count = 0;
+void TaskProgressManager::releaseSlot(Slot &slot)
+{
+  slot.id.store(0, std::memory_order_release);
+  slot.claim.store(0);
+}
 
-    for (auto iter = m_Percentages.begin(); iter != m_Percentages.end();) {
-      if (iter->second.first.secsTo(now) < 15) {
-        total += iter->second.second;
-        ++iter;
-        ++count;
-      } else {
-        // if there was no progress in 15 seconds remove this progress
-        qDebug("no progress in 15 seconds (%d)", iter->second.first.secsTo(now));
-        iter = m_Percentages.erase(iter);
+bool TaskProgressManager::hasActiveSlots() const
+{
+  for (const Slot &slot : m_Slots) {
+    if (slot.id.load(std::memory_order_acquire) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskProgressManager::activate()
+{
+  if (!m_Timer.isActive()) {
+    m_Timer.start(1000 / UpdateRate);
+  }
+}
+
+void TaskProgressManager::aggregate()
+{
+  qint64 now = m_Clock.elapsed();
+  qint64 total = 0;
+  int count = 0;
+  QList<TaskStatus> statuses;
+  TaskStatus combined = { 0, 0, 0, 0.0, -1, 0, false };
+  QList<TaskStatus> finished;
+
+  for (Slot &slot : m_Slots) {
+    quint32 id = slot.id.load(std::memory_order_acquire);
+    if ((slot.seenId != 0) && (id != slot.seenId)) {
+      // completed or forgotten since the last round. Unless the slot was taken by another
+      // task already it still holds the final values
+      TaskStatus status = slot.status;
+      if (id == 0) {
+        qint64 value = slot.value.load();
+        qint64 max = slot.max.load();
+        // a new task claiming the slot resets the values before it becomes visible
+        if (slot.claim.load() == 0) {
+          status.value = value;
+          status.max = max;
+          status.eta = value >= max ? 0 : -1;
+        }
+      }
+      status.elapsed = now - slot.firstSeen;
+      finished.append(status);
+      slot.seenId = 0;
+    }
+    if (id == 0) {
+      continue;
+    }
+
+    qint64 value = slot.value.load(std::memory_order_relaxed);
+    qint64 max = slot.max.load(std::memory_order_relaxed);
+    quint32 sequence = slot.sequence.load(std::memory_order_acquire);
+    TaskStatus &status = slot.status;
+
+    if (id != slot.seenId) {
+      slot.seenId = id;
+      slot.seenSequence = sequence;
+      slot.firstSeen = slot.lastChange = slot.lastReport = slot.lastSample = now;
+      slot.lastValue = slot.seenValue = value;
+      slot.hasRate = false;
+      status = { id, value, max, 0.0, -1, 0, false };
+    } else {
+      // reports keep the task alive, only a changing value counts as progress
+      if (sequence != slot.seenSequence) {
+        slot.seenSequence = sequence;
+        slot.lastReport = now;
+      }
+      if (value != slot.seenValue) {
+        slot.seenValue = value;
+        slot.lastChange = now;
+      }
+
+      qint64 interval = now - slot.lastSample;
+      if (interval > 0) {
+        double current = std::max(0.0, static_cast<double>(value - slot.lastValue) * 1000.0 / interval);
+        if (slot.hasRate) {
+          double weight = 1.0 - std::exp(-static_cast<double>(interval) / ThroughputSmoothing);
+          status.throughput += weight * (current - status.throughput);
+        } else {
+          status.throughput = current;
+          slot.hasRate = true;
+        }
+        slot.lastValue = value;
+        slot.lastSample = now;
+      }
+
+      bool stalled = now - slot.lastChange >= StallTimeout;
+      if (stalled != status.stalled) {
+        status.stalled = stalled;
+        emit stallChanged(id, stalled);
+      }
+
+      status.value = value;
+      status.max = max;
+      status.eta = estimateRemaining(value, max, status.throughput);
+      status.elapsed = now - slot.firstSeen;
+
+      if (now - slot.lastReport >= DropTimeout) {
+        qDebug("no progress reported in %d seconds (%u)", DropTimeout / 1000, id);
+        releaseSlot(slot);
+        slot.seenId = 0;
+        finished.append(status);
+        continue;
       }
     }
 
-    m_Taskbar->SetProgressValue(m_WinId, total, count * 100);
+    statuses.append(status);
+    combined.value += value;
+    combined.max += max;
+    combined.throughput += status.throughput;
+    combined.elapsed = std::max(combined.elapsed, status.elapsed);
+    // the combination is stalled if all tasks are
+    combined.stalled = ((statuses.size() == 1) || combined.stalled) && status.stalled;
+
+    if (max > 0) {
+      total += qBound<qint64>(0, (value * 100) / max, 100);
+      ++count;
+    }
+  }
+  combined.eta = estimateRemaining(combined.value, combined.max, combined.throughput);
+
+  {
+    QMutexLocker locker(&m_StatusMutex);
+    m_Status = statuses;
+    m_Total = combined;
+  }
+
+  foreach (const TaskStatus &status, finished) {
+    emit taskFinished(status);
+  }
+
+  if (count == 0) {
+    if ((m_Sink != nullptr) && (m_ShownTotal != 0)) {
+      m_Sink->clearProgress();
+    }
+    m_ShownCompleted = m_ShownTotal = 0;
+  } else if ((total != m_ShownCompleted) || (count * 100 != m_ShownTotal)) {
+    if (m_Sink != nullptr) {
+      m_Sink->setProgress(total, count * 100);
+    }
+    m_ShownCompleted = total;
+    m_ShownTotal = count * 100;
+  }
+
+  if (statuses.isEmpty()) {
+    // an update may have come in before the flag was cleared. In that case either we see
+    // the task or the update sees the cleared flag and activates the timer again
+    m_TimerActive.store(false);
+    if (!hasActiveSlots() || m_TimerActive.exchange(true)) {
+      m_Timer.stop();
+    }
   } else {
-    m_Taskbar->SetProgressState(m_WinId, TBPF_NOPROGRESS);
+    emit tasksUpdated();
   }
 }
 
+QList<TaskStatus> TaskProgressManager::tasks() const
+{
+  QMutexLocker locker(&m_StatusMutex);
+  return m_Status;
+}
+
+bool TaskProgressManager::task(quint32 id, TaskStatus &status) const
+{
+  QMutexLocker locker(&m_StatusMutex);
+  foreach (const TaskStatus &iter, m_Status) {
+    if (iter.id == id) {
+      status = iter;
+      return true;
+    }
+  }
+  return false;
+}
+
+TaskStatus TaskProgressManager::total() const
+{
+  QMutexLocker locker(&m_StatusMutex);
+  return m_Total;
+}
+
 
 bool TaskProgressManager::tryCreateTaskbar()
 {
+#ifdef Q_OS_WIN
   // try to find our main window
+  HWND winId = nullptr;
   foreach (QWidget *widget, QApplication::topLevelWidgets()) {
     QMainWindow *mainWin = qobject_cast<QMainWindow*>(widget);
     if (mainWin != nullptr) {
-      m_WinId = reinterpret_cast<HWND>(mainWin->winId());
+      winId = reinterpret_cast<HWND>(mainWin->winId());
     }
   }
 
-  if (m_WinId != nullptr) {
-    HRESULT result = CoCreateInstance(CLSID_TaskbarList, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&m_Taskbar));
+  if (winId != nullptr) {
+    ITaskbarList3 *taskbar = nullptr;
+    HRESULT result = CoCreateInstance(CLSID_TaskbarList, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&taskbar));
     if (result == S_OK) {
+      setSink(new TaskbarSink(winId, taskbar));
       return true;
     }
   }
 
   // if we got here we got no connection to the taskbar
 
-  m_Taskbar = nullptr;
-
   if (m_CreateTries-- > 0) {
     QTimer::singleShot(1000, this, SLOT(tryCreateTaskbar()));
     qWarning("failed to create taskbar connection (this is to be expected on Windows XP)");
   }
+#endif
   return false;
 }
 
 TaskProgressManager::TaskProgressManager()
-  : m_NextId(1), m_CreateTries(10), m_WinId(nullptr), m_Taskbar(nullptr)
+  : m_NextId(1), m_TimerActive(false)
+  , m_ShownCompleted(0), m_ShownTotal(0), m_CreateTries(10)
+{
+  m_Claiming.clear();
+  for (Slot &slot : m_Slots) {
+    slot.claim = 0;
+    slot.id = 0;
+    slot.value = 0;
+    slot.max = 0;
+    slot.sequence = 0;
+    slot.seenId = 0;
+    slot.seenSequence = 0;
+    slot.firstSeen = 0;
+    slot.lastChange = 0;
+    slot.lastReport = 0;
+    slot.seenValue = 0;
+    slot.lastSample = 0;
+    slot.lastValue = 0;
+    slot.hasRate = false;
+    slot.status = { 0, 0, 0, 0.0, -1, 0, false };
+  }
+  m_Total = { 0, 0, 0, 0.0, -1, 0, false };
+  m_Clock.start();
+  // a child so it moves to the gui thread along with the manager
+  m_Timer.setParent(this);
+  qRegisterMetaType<TaskStatus>();
+  QObject::connect(&m_Timer, &QTimer::timeout, this, &TaskProgressManager::aggregate);
+}
+
+TaskProgressManager::~TaskProgressManager()
 {
 }
 
@@ -1,22 +1,89 @@
 #ifndef TASKPROGRESSMANAGER_H
 #define TASKPROGRESSMANAGER_H
 
+#include <QElapsedTimer>
+#include <QList>
+#include <QMetaType>
+#include <QMutex>
 #include <QObject>
-#include <QMutexLocker>
 #include <QTimer>
-#include <QTime>
-#include <map>
-#include <Windows.h>
-#include <shobjidl.h>
+#include <atomic>
+#include <memory>
 #include "dllimport.h"
 
 namespace MOBase {
 
-class QDLLEXPORT TaskProgressManager : QObject
+
+/**
+ * @brief receives the combined progress of all tasks, i.e. to display it in the taskbar
+ */
+class QDLLEXPORT ITaskProgressSink
+{
+public:
+  virtual ~ITaskProgressSink() {}
+
+  /**
+   * @brief show progress
+   * @param completed amount of work done
+   * @param total total amount of work
+   */
+  virtual void setProgress(qint64 completed, qint64 total) = 0;
+
+  /**
+   * @brief no task is running anymore
+   */
+  virtual void clearProgress() = 0;
+};
+
+
+/**
+ * @brief state of a task as seen by the last aggregation
+ */
+struct TaskStatus {
+  // 0 for the combination of all tasks
+  quint32 id;
+  // progress in whatever unit the task reports, i.e. bytes or items
+  qint64 value;
+  qint64 max;
+  // smoothed units per second
+  double throughput;
+  // estimated milliseconds until completion, -1 if unknown
+  qint64 eta;
+  // milliseconds since the task first reported progress
+  qint64 elapsed;
+  // true if there was no progress for TaskProgressManager::StallTimeout milliseconds
+  bool stalled;
+};
+
+
+/**
+ * @brief combines the progress of tasks running on any thread
+ *
+ * Updates only write to a slot reserved for the task and never block, only the first update
+ * of a task may briefly wait for other tasks claiming a slot. The combined progress
+ * is computed and passed to the sink on the main thread at a fixed rate. Throughput, estimated
+ * time of completion and stall state of each task are derived at the same time and can be
+ * queried or observed through signals.
+ */
+class QDLLEXPORT TaskProgressManager : public QObject
 {
 
   Q_OBJECT
 
+public:
+
+  // maximum number of tasks tracked at the same time. Updates for further tasks are ignored
+  static const int MaxTasks = 64;
+
+  // how often the combined progress is updated per second
+  static const int UpdateRate = 10;
+
+  // milliseconds without progress after which a task is reported as stalled
+  static const int StallTimeout = 5000;
+
+  // milliseconds without any update after which a task is considered dead and removed
+  static const int DropTimeout = 15000;
+
 public:
 
   static TaskProgressManager &instance();
@@ -26,26 +93,119 @@ public:
 
   quint32 getId();
 
+  /**
+   * @brief set where the combined progress is displayed
+   * @param sink the new sink. The manager takes custody of the pointer. nullptr only stops
+   *             the display, tasks are still tracked
+   */
+  void setSink(ITaskProgressSink *sink);
+
+  /**
+   * @return status of all tracked tasks as of the last aggregation
+   */
+  QList<TaskStatus> tasks() const;
+
+  /**
+   * @brief retrieve the status of a single task
+   * @return false if the task isn't tracked (anymore)
+   */
+  bool task(quint32 id, TaskStatus &status) const;
+
+  /**
+   * @return the combination of all tasks. Values are the sums over all tasks, the eta is
+   *         based on the combined throughput
+   */
+  TaskStatus total() const;
+
+signals:
+
+  /**
+   * @brief emitted after every aggregation while tasks are running
+   */
+  void tasksUpdated();
+
+  /**
+   * @brief a task stopped or resumed making progress
+   */
+  void stallChanged(quint32 id, bool stalled);
+
+  /**
+   * @brief a task completed, was forgotten or was dropped because it stalled for too long
+   * @param status the last status of the task
+   */
+  void taskFinished(const MOBase::TaskStatus &status);
+
 public slots:
+  /**
+   * @brief connect to the windows taskbar of the main window and use it as the sink.
+   *        Retries for a while if there is no main window yet
+   * @return true if the connection was made
+   */
   bool tryCreateTaskbar();
+
+private slots:
+
+  void activate();
+  void aggregate();
+
 private:
 
-  TaskProgressManager();
-  void showProgress();
+  struct Slot {
+    // id of the task owning the slot, 0 if the slot is free
+    std::atomic<quint32> claim;
+    // id of the task once the slot is ready for updates, 0 while it is free or being claimed
+    std::atomic<quint32> id;
+    std::atomic<qint64> value;
+    std::atomic<qint64> max;
+    // incremented on every update so the aggregation can tell stalled tasks
+    std::atomic<quint32> sequence;
+
+    // only accessed during aggregation
+    quint32 seenId;
+    quint32 seenSequence;
+    qint64 firstSeen;
+    // time of the last change of the value, for the stall state
+    qint64 lastChange;
+    // time of the last update, even without a change. Tasks not reporting at all are dropped
+    qint64 lastReport;
+    qint64 seenValue;
+    qint64 lastSample;
+    qint64 lastValue;
+    bool hasRate;
+    TaskStatus status;
+  };
 
 private:
 
-  std::map<quint32, std::pair<QTime, qint64> > m_Percentages;
-  QMutex m_Mutex;
-  quint32 m_NextId;
-  QTimer m_CreateTimer;
-  int m_CreateTries;
+  TaskProgressManager();
+  ~TaskProgressManager();
+
+  Slot *findSlot(quint32 id, bool create);
+  void releaseSlot(Slot &slot);
+  bool hasActiveSlots() const;
 
-  HWND m_WinId;
+private:
 
-  ITaskbarList3 *m_Taskbar;
+  Slot m_Slots[MaxTasks];
+  std::atomic<quint32> m_NextId;
+  // held while a new task claims a slot
+  std::atomic_flag m_Claiming;
+  std::atomic<bool> m_TimerActive;
+  QTimer m_Timer;
+  QElapsedTimer m_Clock;
+
+  mutable QMutex m_StatusMutex;
+  QList<TaskStatus> m_Status;
+  TaskStatus m_Total;
+
+  std::unique_ptr<ITaskProgressSink> m_Sink;
+  qint64 m_ShownCompleted;
+  qint64 m_ShownTotal;
+  int m_CreateTries;
 };
 
 }
 
+Q_DECLARE_METATYPE(MOBase::TaskStatus)
+
 #endif // TASKPROGRESSMANAGER_H
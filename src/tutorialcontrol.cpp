@@ -20,7 +20,9 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include "tutorialcontrol.h"
 #include <QCoreApplication>
 #include <QDeclarativeEngine>
+#include <QDeclarativeComponent>
 #include <QDeclarativeContext>
+#include <QDeclarativeError>
 #include <QDebug>
 #include <QFile>
 #include <QDir>
@@ -34,7 +36,6 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include "utility.h"
 #include "tutorialmanager.h"
 #include "report.h"
-#include <boost/scoped_array.hpp>
 #include <QImage>
 #include <QBitmap>
 
@@ -47,6 +48,20 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 namespace MOBase {
 
 
+namespace {
+
+/**
+ * view that displays an object created from a cached component instead of loading a source
+ */
+class TutorialView : public QDeclarativeView {
+public:
+  TutorialView(QWidget *parent) : QDeclarativeView(parent) {}
+  void setRoot(QObject *root) { setRootObject(root); }
+};
+
+}
+
+
 TutorialControl::TutorialControl(const TutorialControl &reference)
   : QObject(reference.parent())
   , m_TargetControl(reference.m_TargetControl)
@@ -68,6 +83,8 @@ TutorialControl::TutorialControl(QWidget *targetControl, const QString &name)
   , m_ExpectedTab(0)
   , m_CurrentClickControl(nullptr)
 {
+  // the window is usually shown a moment later, use that time to compile its tutorial
+  m_Manager.preloadTutorial(m_Name);
 }
 
 
@@ -98,46 +115,46 @@ void TutorialControl::expose(const QString &widgetName, QObject *widget)
 }
 
 
-static QString canonicalPath(const QString &path)
-{
-  boost::scoped_array<wchar_t> buffer(new wchar_t[32768]);
-  DWORD res = ::GetShortPathNameW((wchar_t*)path.utf16(), buffer.get(), 32768);
-  if (res == 0) {
-    return path;
-  }
-  res = ::GetLongPathNameW(buffer.get(), buffer.get(), 32768);
-  if (res == 0) {
-    return path;
-  }
-  return QString::fromWCharArray(buffer.get());
-}
-
 void TutorialControl::startTutorial(const QString &tutorial)
 {
   if (m_TutorialView == nullptr) {
-    m_TutorialView = new QDeclarativeView(m_TargetControl);
+    QDeclarativeComponent *component = m_Manager.tutorialComponent(m_Name);
+    if (component == nullptr) {
+      reportError(tr("Tutorial failed to start, please check \"mo_interface.log\" for details."));
+      return;
+    }
+
+    TutorialView *view = new TutorialView(m_TargetControl);
+    m_TutorialView = view;
     m_TutorialView->setResizeMode(QDeclarativeView::SizeRootObjectToView);
     m_TutorialView->setStyleSheet("background: transparent");
     m_TutorialView->setObjectName("tutorialView");
-    m_TutorialView->rootContext()->setContextProperty("manager", &m_Manager);
 
-    QString qmlName = canonicalPath(QCoreApplication::applicationDirPath() + "/tutorials") + "/tutorials_" + m_Name.toLower() + ".qml";
-    QUrl qmlSource = QUrl::fromLocalFile(qmlName);
-
-    m_TutorialView->setSource(qmlSource);
-    m_TutorialView->resize(m_TargetControl->width(), m_TargetControl->height());
-    m_TutorialView->rootContext()->setContextProperty("scriptName", tutorial);
-    m_TutorialView->rootContext()->setContextProperty("tutorialControl", this);
-    m_TutorialView->rootContext()->setContextProperty("applicationWindow", m_TargetControl);
-    m_TutorialView->rootContext()->setContextProperty("organizer", m_Manager.organizerCore());
+    // the context belongs to the shared engine of the component, not the view
+    QDeclarativeContext *context = new QDeclarativeContext(component->engine()->rootContext(), m_TutorialView);
+    context->setContextProperty("manager", &m_Manager);
+    context->setContextProperty("scriptName", tutorial);
+    context->setContextProperty("tutorialControl", this);
+    context->setContextProperty("applicationWindow", m_TargetControl);
+    context->setContextProperty("organizer", m_Manager.organizerCore());
 
     for (std::vector<std::pair<QString, QObject*> >::const_iterator iter = m_ExposedObjects.begin();
          iter != m_ExposedObjects.end(); ++iter) {
-      m_TutorialView->rootContext()->setContextProperty(iter->first, iter->second);
+      context->setContextProperty(iter->first, iter->second);
     }
+
+    QObject *root = component->create(context);
+    if (root == nullptr) {
+      foreach (const QDeclarativeError &error, component->errors()) {
+        qCritical("%s", qPrintable(error.toString()));
+      }
+    } else {
+      view->setRoot(root);
+    }
+    m_TutorialView->resize(m_TargetControl->width(), m_TargetControl->height());
     m_TutorialView->show();
     m_TutorialView->raise();
-    if (!QMetaObject::invokeMethod(m_TutorialView->rootObject(), "init")) {
+    if ((root == nullptr) || !QMetaObject::invokeMethod(m_TutorialView->rootObject(), "init")) {
       reportError(tr("Tutorial failed to start, please check \"mo_interface.log\" for details."));
       m_TutorialView->close();
     }
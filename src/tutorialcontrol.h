@@ -69,6 +69,8 @@ private:
 
   QWidget *m_TargetControl;
   QString m_Name;
+  // only displays the tutorial. The tutorial itself lives in TutorialManager::engine(), the
+  // engine of the view is unused
   QDeclarativeView *m_TutorialView;
 
   TutorialManager &m_Manager;
@@ -21,9 +21,17 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include "tutorialcontrol.h"
 #include "utility.h"
 #include <QDir>
+#include <QFileInfo>
 #include <QString>
 #include <QDebug>
 #include <QApplication>
+#include <QDeclarativeComponent>
+#include <QDeclarativeEngine>
+#include <QDeclarativeError>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QUrl>
+#include <boost/scoped_array.hpp>
 
 
 namespace MOBase {
@@ -32,9 +40,61 @@ namespace MOBase {
 TutorialManager *TutorialManager::s_Instance = nullptr;
 
 
+namespace {
+
+/**
+ * reads tutorial interface files and passes them back to the manager for compilation
+ */
+class PreloadJob : public QRunnable {
+public:
+  PreloadJob(TutorialManager *manager, const QString &directory, const QString &nameFilter)
+    : m_Manager(manager), m_Directory(directory), m_NameFilter(nameFilter)
+  {}
+
+  virtual void run() override
+  {
+    QDir dir(m_Directory);
+    foreach (const QString &fileName, dir.entryList(QStringList(m_NameFilter), QDir::Files)) {
+      QFile file(dir.absoluteFilePath(fileName));
+      if (!file.open(QIODevice::ReadOnly)) {
+        qWarning("failed to preload tutorial \"%s\": %s",
+                 qPrintable(file.fileName()), qPrintable(file.errorString()));
+        continue;
+      }
+      // compilation has to happen on the thread of the engine
+      QMetaObject::invokeMethod(m_Manager, "preloaded", Qt::QueuedConnection,
+                                Q_ARG(QString, file.fileName()), Q_ARG(QByteArray, file.readAll()));
+    }
+  }
+
+private:
+  TutorialManager *m_Manager;
+  QString m_Directory;
+  QString m_NameFilter;
+};
+
+}
+
+
+static QString canonicalPath(const QString &path)
+{
+  boost::scoped_array<wchar_t> buffer(new wchar_t[32768]);
+  DWORD res = ::GetShortPathNameW((wchar_t*)path.utf16(), buffer.get(), 32768);
+  if (res == 0) {
+    return path;
+  }
+  res = ::GetLongPathNameW(buffer.get(), buffer.get(), 32768);
+  if (res == 0) {
+    return path;
+  }
+  return QString::fromWCharArray(buffer.get());
+}
+
+
 TutorialManager::TutorialManager(const QString &tutorialPath, QObject *organizerCore)
   : m_TutorialPath(tutorialPath)
   , m_OrganizerCore(organizerCore)
+  , m_Engine(nullptr)
 {
 }
 
@@ -114,4 +174,106 @@ void TutorialManager::unregisterControl(const QString &windowName)
     qWarning() << "failed to remove tutorial control " << windowName;
   }
 }
+
+
+QString TutorialManager::tutorialDirectory()
+{
+  if (m_TutorialDirectory.isEmpty()) {
+    m_TutorialDirectory = canonicalPath(QCoreApplication::applicationDirPath() + "/tutorials");
+  }
+  return m_TutorialDirectory;
+}
+
+
+QDeclarativeEngine *TutorialManager::engine()
+{
+  if (m_Engine == nullptr) {
+    m_Engine = new QDeclarativeEngine(this);
+  }
+  return m_Engine;
+}
+
+
+QString TutorialManager::qmlFileName(const QString &windowName) const
+{
+  return "tutorials_" + windowName.toLower() + ".qml";
+}
+
+
+QString TutorialManager::componentKey(const QString &fileName) const
+{
+  // the same file may be named differently by the preload and by a direct request
+  QString key = QDir::cleanPath(QFileInfo(QDir::fromNativeSeparators(fileName)).absoluteFilePath());
+#ifdef Q_OS_WIN
+  key = key.toLower();
+#endif
+  return key;
+}
+
+
+QDeclarativeComponent *TutorialManager::tutorialComponent(const QString &windowName)
+{
+  QString fileName = tutorialDirectory() + "/" + qmlFileName(windowName);
+  std::map<QString, QDeclarativeComponent*>::iterator iter = m_Components.find(componentKey(fileName));
+  if (iter != m_Components.end()) {
+    return iter->second;
+  }
+
+  // not preloaded (yet), compile right away
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qCritical("failed to open tutorial \"%s\": %s",
+              qPrintable(fileName), qPrintable(file.errorString()));
+    return nullptr;
+  }
+  return compile(fileName, file.readAll());
+}
+
+
+void TutorialManager::preloadTutorial(const QString &windowName)
+{
+  if (m_Components.find(componentKey(tutorialDirectory() + "/" + qmlFileName(windowName))) == m_Components.end()) {
+    startPreload(qmlFileName(windowName));
+  }
+}
+
+
+void TutorialManager::preloadTutorials()
+{
+  startPreload(qmlFileName("*"));
+}
+
+
+void TutorialManager::startPreload(const QString &nameFilter)
+{
+  // the directory is determined here so the job doesn't touch the manager
+  QThreadPool::globalInstance()->start(new PreloadJob(this, tutorialDirectory(), nameFilter));
+}
+
+
+void TutorialManager::preloaded(const QString &fileName, const QByteArray &data)
+{
+  // the tutorial may have been needed before the preload finished
+  if (m_Components.find(componentKey(fileName)) == m_Components.end()) {
+    compile(fileName, data);
+  }
+}
+
+
+QDeclarativeComponent *TutorialManager::compile(const QString &fileName, const QByteArray &data)
+{
+  QDeclarativeComponent *component = new QDeclarativeComponent(engine(), this);
+  component->setData(data, QUrl::fromLocalFile(fileName));
+  if (component->isError()) {
+    foreach (const QDeclarativeError &error, component->errors()) {
+      qCritical("%s", qPrintable(error.toString()));
+    }
+    // not cached so a fixed file can be picked up
+    delete component;
+    return nullptr;
+  }
+  m_Components[componentKey(fileName)] = component;
+  return component;
+}
+
 } // namespace MOBase
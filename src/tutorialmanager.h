@@ -24,9 +24,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 
 #include "dllimport.h"
+#include <QByteArray>
 #include <QObject>
+#include <QString>
 #include <map>
 
+class QDeclarativeComponent;
+class QDeclarativeEngine;
+
 namespace MOBase {
 
 
@@ -87,6 +92,41 @@ public:
   Q_INVOKABLE void finishWindowTutorial(const QString &windowName);
 
   Q_INVOKABLE QWidget *findControl(const QString &controlName);
+
+  /**
+   * @return the directory containing the tutorial qml files. Determined only once
+   */
+  QString tutorialDirectory();
+
+  /**
+   * @brief retrieve the compiled tutorial interface for a window. The file is compiled on
+   *        first use unless it was preloaded, after that the compiled component is reused
+   * @param windowName name of the window the tutorial is for
+   * @return the component or nullptr if the file couldn't be compiled. The component is owned
+   *         by the manager and belongs to the engine returned by engine()
+   */
+  QDeclarativeComponent *tutorialComponent(const QString &windowName);
+
+  /**
+   * @brief read the tutorial interface for a window on a background thread and compile it
+   *        once the application is idle, so a later tutorialComponent call doesn't block
+   * @param windowName name of the window the tutorial is for
+   */
+  void preloadTutorial(const QString &windowName);
+
+  /**
+   * @brief preload the tutorial interfaces of all windows
+   */
+  void preloadTutorials();
+
+  /**
+   * @return the engine shared by all tutorial views. Tutorial objects are created in this
+   *         engine, not in the engine of the QDeclarativeView displaying them, so import
+   *         paths, image providers or a network access manager for tutorials have to be
+   *         set up here. Settings on the engine of a view have no effect on tutorials
+   */
+  QDeclarativeEngine *engine();
+
 signals:
 
   void windowTutorialFinished(const QString &windowName);
@@ -97,6 +137,15 @@ private:
 
   TutorialManager(const QString &tutorialPath, QObject *organizerCore);
 
+  QString qmlFileName(const QString &windowName) const;
+  QString componentKey(const QString &fileName) const;
+  QDeclarativeComponent *compile(const QString &fileName, const QByteArray &data);
+  void startPreload(const QString &nameFilter);
+
+private slots:
+
+  void preloaded(const QString &fileName, const QByteArray &data);
+
 private:
 
   static TutorialManager *s_Instance;
@@ -108,6 +157,11 @@ private:
   std::map<QString, TutorialControl*> m_Controls;
   std::map<QString, QString> m_PendingTutorials;
 
+  QString m_TutorialDirectory;
+  QDeclarativeEngine *m_Engine;
+  // compiled tutorial interfaces by componentKey of the file name
+  std::map<QString, QDeclarativeComponent*> m_Components;
+
 };
 
 
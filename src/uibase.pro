@@ -47,7 +47,15 @@ SOURCES += \
     sortabletreewidget.cpp \
     executableinfo.cpp \
     delayedfilewriter.cpp \
-    filenamestring.cpp
+    filenamestring.cpp \
+    filecopy.cpp \
+    fileremove.cpp \
+    utf8.cpp \
+    iconcache.cpp \
+    fileoperationqueue.cpp \
+    filehash.cpp \
+    directoryscanner.cpp \
+    globpattern.cpp
 
 HEADERS +=\
     utility.h \
@@ -78,6 +86,7 @@ HEADERS +=\
     guessedvalue.h \
     ipluginproxy.h \
     json.h \
+    jsonbinding.h \
     imodrepositorybridge.h \
     idownloadmanager.h \
     nxmurl.h \
@@ -97,7 +106,15 @@ HEADERS +=\
     isavegame.h \
     isavegameinfowidget.h \
     filemapping.h \
-    ipluginfilemapper.h
+    ipluginfilemapper.h \
+    filecopy.h \
+    fileremove.h \
+    utf8.h \
+    iconcache.h \
+    fileoperationqueue.h \
+    filehash.h \
+    directoryscanner.h \
+    globpattern.h
 
 FORMS += \
     textviewer.ui \
@@ -0,0 +1,229 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "utf8.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define UTF8_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace MOBase {
+
+
+static const qint64 BlockSize = 16;
+
+/**
+ * @return true if the 16 bytes at data are all ascii
+ */
+static inline bool isAsciiBlock(const unsigned char *data)
+{
+#ifdef UTF8_USE_SSE2
+  __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+  return _mm_movemask_epi8(block) == 0;
+#else
+  quint64 first;
+  quint64 second;
+  memcpy(&first, data, sizeof(first));
+  memcpy(&second, data + sizeof(first), sizeof(second));
+  return ((first | second) & Q_UINT64_C(0x8080808080808080)) == 0;
+#endif
+}
+
+
+qint64 validUtf8Length(const char *data, qint64 size)
+{
+  const unsigned char *begin = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char *end = begin + size;
+  const unsigned char *pos = begin;
+
+  while (pos < end) {
+    unsigned char lead = *pos;
+    if (lead < 0x80) {
+      // most text is predominantly ascii, skip over it in blocks. The block test is
+      // only attempted on ascii so it doesn't keep failing inside non-ascii text
+      while ((end - pos >= BlockSize) && isAsciiBlock(pos)) {
+        pos += BlockSize;
+      }
+      while ((pos < end) && (*pos < 0x80)) {
+        ++pos;
+      }
+      continue;
+    }
+
+    // valid range of the second byte depends on the lead byte (see RFC 3629)
+    int length = 0;
+    unsigned char secondMin = 0x80;
+    unsigned char secondMax = 0xBF;
+    if ((lead >= 0xC2) && (lead <= 0xDF)) {
+      length = 2;
+    } else if ((lead >= 0xE0) && (lead <= 0xEF)) {
+      length = 3;
+      if (lead == 0xE0) {
+        secondMin = 0xA0; // overlong
+      } else if (lead == 0xED) {
+        secondMax = 0x9F; // surrogates
+      }
+    } else if ((lead >= 0xF0) && (lead <= 0xF4)) {
+      length = 4;
+      if (lead == 0xF0) {
+        secondMin = 0x90; // overlong
+      } else if (lead == 0xF4) {
+        secondMax = 0x8F; // beyond U+10FFFF
+      }
+    } else {
+      break;
+    }
+
+    if ((end - pos < length) || (pos[1] < secondMin) || (pos[1] > secondMax)) {
+      break;
+    }
+    bool valid = true;
+    for (int i = 2; i < length; ++i) {
+      if ((pos[i] & 0xC0) != 0x80) {
+        valid = false;
+        break;
+      }
+    }
+    if (!valid) {
+      break;
+    }
+    pos += length;
+  }
+
+  return pos - begin;
+}
+
+
+int utf16ToUtf8(const ushort *source, int length, char *destination)
+{
+  const ushort *end = source + length;
+  char *out = destination;
+
+  while (source < end) {
+#ifdef UTF8_USE_SSE2
+    // 8 ascii characters at a time, narrowed with a saturating pack
+    while (end - source >= 8) {
+      __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+      __m128i high = _mm_and_si128(chars, _mm_set1_epi16(static_cast<short>(0xFF80)));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) {
+        break;
+      }
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(chars, chars));
+      source += 8;
+      out += 8;
+    }
+    if (source >= end) {
+      break;
+    }
+#endif
+
+    uint codePoint = *source++;
+    if (codePoint < 0x80) {
+      *out++ = static_cast<char>(codePoint);
+      continue;
+    } else if (codePoint < 0x800) {
+      *out++ = static_cast<char>(0xC0 | (codePoint >> 6));
+      *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+      continue;
+    } else if ((codePoint >= 0xD800) && (codePoint <= 0xDFFF)) {
+      if ((codePoint <= 0xDBFF) && (source < end) && (*source >= 0xDC00) && (*source <= 0xDFFF)) {
+        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (*source++ - 0xDC00);
+        *out++ = static_cast<char>(0xF0 | (codePoint >> 18));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+        continue;
+      }
+      codePoint = 0xFFFD;
+    }
+    *out++ = static_cast<char>(0xE0 | (codePoint >> 12));
+    *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+
+  return static_cast<int>(out - destination);
+}
+
+
+int utf8ToUtf16(const char *source, int length, ushort *destination)
+{
+  const unsigned char *pos = reinterpret_cast<const unsigned char*>(source);
+  const unsigned char *end = pos + length;
+  ushort *out = destination;
+
+  while (pos < end) {
+#ifdef UTF8_USE_SSE2
+    // 16 ascii characters at a time, widened by interleaving with zeros
+    while ((end - pos >= BlockSize) && isAsciiBlock(pos)) {
+      __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(chars, _mm_setzero_si128()));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(chars, _mm_setzero_si128()));
+      pos += BlockSize;
+      out += BlockSize;
+    }
+    if (pos >= end) {
+      break;
+    }
+#endif
+
+    unsigned char lead = *pos;
+    if (lead < 0x80) {
+      *out++ = lead;
+      ++pos;
+      continue;
+    }
+
+    // validUtf8Length does all the checking of the sequence
+    qint64 available = std::min<qint64>(end - pos, 4);
+    int sequenceLength = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : 2;
+    if (validUtf8Length(reinterpret_cast<const char*>(pos), std::min<qint64>(available, sequenceLength))
+        != sequenceLength) {
+      *out++ = 0xFFFD;
+      ++pos;
+      continue;
+    }
+
+    uint codePoint = 0;
+    if (sequenceLength == 2) {
+      codePoint = ((lead & 0x1F) << 6) | (pos[1] & 0x3F);
+    } else if (sequenceLength == 3) {
+      codePoint = ((lead & 0x0F) << 12) | ((pos[1] & 0x3F) << 6) | (pos[2] & 0x3F);
+    } else {
+      codePoint = ((lead & 0x07) << 18) | ((pos[1] & 0x3F) << 12) | ((pos[2] & 0x3F) << 6) | (pos[3] & 0x3F);
+    }
+    pos += sequenceLength;
+
+    if (codePoint >= 0x10000) {
+      codePoint -= 0x10000;
+      *out++ = static_cast<ushort>(0xD800 + (codePoint >> 10));
+      *out++ = static_cast<ushort>(0xDC00 + (codePoint & 0x3FF));
+    } else {
+      *out++ = static_cast<ushort>(codePoint);
+    }
+  }
+
+  return static_cast<int>(out - destination);
+}
+
+} // namespace MOBase
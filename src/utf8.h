@@ -0,0 +1,74 @@
+/*
+Mod Organizer shared UI functionality
+
+Copyright (C) 2012 Sebastian Herbord. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef UTF8_H
+#define UTF8_H
+
+
+#include "dllimport.h"
+#include <QtGlobal>
+
+
+namespace MOBase {
+
+
+/**
+ * @brief determine how much of a buffer is valid utf-8. Overlong encodings, surrogates
+ *        and code points beyond U+10FFFF are considered invalid
+ * @param data the data to check
+ * @param size size of data in bytes
+ * @return number of bytes at the start of data that form complete, valid utf-8 sequences.
+ *         This is size if the whole buffer is valid
+ * @note runs of ascii characters are checked 16 bytes at a time
+ */
+QDLLEXPORT qint64 validUtf8Length(const char *data, qint64 size);
+
+/**
+ * @brief test if a buffer is valid utf-8 in its entirety
+ */
+inline bool isValidUtf8(const char *data, qint64 size)
+{
+  return validUtf8Length(data, size) == size;
+}
+
+/**
+ * @brief convert utf-16 to utf-8
+ * @param source the utf-16 data
+ * @param length number of utf-16 code units in source
+ * @param destination buffer for the result. Has to hold at least 3 * length bytes
+ * @return number of bytes written to destination
+ * @note unpaired surrogates are replaced by U+FFFD. No terminating 0 is written
+ */
+QDLLEXPORT int utf16ToUtf8(const ushort *source, int length, char *destination);
+
+/**
+ * @brief convert utf-8 to utf-16
+ * @param source the utf-8 data
+ * @param length number of bytes in source
+ * @param destination buffer for the result. Has to hold at least length code units
+ * @return number of utf-16 code units written to destination
+ * @note each byte that isn't part of a valid utf-8 sequence is replaced by U+FFFD.
+ *       No terminating 0 is written
+ */
+QDLLEXPORT int utf8ToUtf16(const char *source, int length, ushort *destination);
+
+} // namespace MOBase
+
+#endif // UTF8_H
@@ -21,7 +21,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "utility.h"
 #include "report.h"
+#include "filecopy.h"
+#include "fileremove.h"
+#include "globpattern.h"
+#include "utf8.h"
+#include "iconcache.h"
 #include <memory>
+#include <cstring>
 #include <boost/scoped_array.hpp>
 #include <QDir>
 #include <QBuffer>
@@ -29,7 +35,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <QApplication>
 #include <QTextCodec>
 #include <QtDebug>
-#include <QtWinExtras/QtWin>
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <ShlObj.h>
@@ -71,30 +76,26 @@ QString windowsErrorString(DWORD errorCode)
 
 bool removeDir(const QString &dirName)
 {
-  QDir dir(dirName);
+  if (!QFileInfo(dirName).isDir()) {
+    reportError(QObject::tr("\"%1\" doesn't exist (remove)").arg(dirName));
+    return false;
+  }
 
-  if (dir.exists()) {
-    Q_FOREACH(QFileInfo info, dir.entryInfoList(QDir::NoDotAndDotDot | QDir::System | QDir::Hidden  | QDir::AllDirs | QDir::Files, QDir::DirsFirst)) {
-      if (info.isDir()) {
-        if (!removeDir(info.absoluteFilePath())) {
-          return false;
-        }
-      } else {
-        ::SetFileAttributesW(ToWString(info.absoluteFilePath()).c_str(), FILE_ATTRIBUTE_NORMAL);
-        QFile file(info.absoluteFilePath());
-        if (!file.remove()) {
-          reportError(QObject::tr("removal of \"%1\" failed: %2").arg(info.absoluteFilePath()).arg(file.errorString()));
-          return false;
-        }
-      }
+  RemoveReport report;
+  if (!removeDirParallel(dirName, &report)) {
+    foreach (const FileRemoveError &error, report.errors) {
+      qWarning("removal of \"%s\" failed: %s", qPrintable(error.path), qPrintable(error.message));
     }
-
-    if (!dir.rmdir(dirName)) {
-      reportError(QObject::tr("removal of \"%1\" failed").arg(dir.absolutePath()));
-      return false;
+    if (report.errors.isEmpty()) {
+      reportError(QObject::tr("removal of \"%1\" failed").arg(dirName));
+    } else if (report.errors.size() == 1) {
+      reportError(QObject::tr("removal of \"%1\" failed: %2")
+                  .arg(report.errors.first().path).arg(report.errors.first().message));
+    } else {
+      reportError(QObject::tr("removal of \"%1\" failed: %2 (%3 more errors)")
+                  .arg(report.errors.first().path).arg(report.errors.first().message)
+                  .arg(report.errors.size() - 1));
     }
-  } else {
-    reportError(QObject::tr("\"%1\" doesn't exist (remove)").arg(dirName));
     return false;
   }
 
@@ -102,33 +103,15 @@ bool removeDir(const QString &dirName)
 }
 
 
-bool copyDir(const QString &sourceName, const QString &destinationName, bool merge)
+bool copyDir(const QString &sourceName, const QString &destinationName, bool merge, DeployMode mode)
 {
-  QDir sourceDir(sourceName);
-  if (!sourceDir.exists()) {
+  CopyReport report;
+  if (!copyDirParallel(sourceName, destinationName, merge, &report, 0, mode)) {
     return false;
   }
-  QDir destDir(destinationName);
-  if (!destDir.exists()) {
-    destDir.mkdir(destinationName);
-  } else if (!merge) {
-    return false;
-  }
-
-  QStringList files = sourceDir.entryList(QDir::Files);
-  foreach (QString fileName, files) {
-    QString srcName = sourceName + "/" + fileName;
-    QString destName = destinationName + "/" + fileName;
-    QFile::copy(srcName, destName);
-  }
-
-  files.clear();
-  // we leave out symlinks because that could cause an endless recursion
-  QStringList subDirs = sourceDir.entryList(QDir::AllDirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
-  foreach (QString subDir, subDirs) {
-    QString srcName = sourceName + "/" + subDir;
-    QString destName = destinationName + "/" + subDir;
-    copyDir(srcName, destName, merge);
+  foreach (const FileCopyError &error, report.errors) {
+    qWarning("failed to copy \"%s\" to \"%s\": %s", qPrintable(error.source),
+             qPrintable(error.destination), qPrintable(error.message));
   }
   return true;
 }
@@ -293,7 +276,8 @@ bool moveFileRecursive(const QString &source, const QString &baseDir, const QStr
   return true;
 }
 
-bool copyFileRecursive(const QString &source, const QString &baseDir, const QString &destination)
+bool copyFileRecursive(const QString &source, const QString &baseDir, const QString &destination,
+                       DeployMode mode, DeployMethod *method)
 {
   QStringList pathComponents = destination.split("/");
   QString path = baseDir;
@@ -306,50 +290,112 @@ bool copyFileRecursive(const QString &source, const QString &baseDir, const QStr
   }
 
   QString destinationAbsolute = baseDir.mid(0).append("/").append(destination);
-  if (!QFile::copy(source, destinationAbsolute)) {
-    reportError(QObject::tr("failed to copy \"%1\" to \"%2\"").arg(source).arg(destinationAbsolute));
+  QString errorMessage;
+  if (!deployFile(source, destinationAbsolute, mode, method, &errorMessage)) {
+    reportError(QObject::tr("failed to copy \"%1\" to \"%2\": %3")
+                .arg(source).arg(destinationAbsolute).arg(errorMessage));
     return false;
   }
   return true;
 }
 
+static bool transferFilesRecursive(const QList<QPair<QString, QString>> &files, const QString &baseDir,
+                                   TransferMode mode, DeployMode deployMode)
+{
+  QList<FileTransfer> transfers;
+  transfers.reserve(files.size());
+  for (const QPair<QString, QString> &file : files) {
+    transfers.append({ file.first, file.second });
+  }
 
-std::wstring ToWString(const QString &source)
+  CopyReport report;
+  if (transferFiles(transfers, baseDir, mode, &report, 0, deployMode)) {
+    return true;
+  }
+
+  foreach (const FileCopyError &error, report.errors) {
+    qWarning("failed to transfer \"%s\" to \"%s\": %s", qPrintable(error.source),
+             qPrintable(error.destination), qPrintable(error.message));
+  }
+  const FileCopyError &first = report.errors.first();
+  QString message = QObject::tr("failed to copy \"%1\" to \"%2\": %3")
+                      .arg(first.source).arg(first.destination).arg(first.message);
+  if (report.errors.size() > 1) {
+    message += " " + QObject::tr("(%1 more errors)").arg(report.errors.size() - 1);
+  }
+  reportError(message);
+  return false;
+}
+
+bool moveFilesRecursive(const QList<QPair<QString, QString>> &files, const QString &baseDir)
 {
-  //FIXME
-  //why not source.toStdWString() ?
-  wchar_t *buffer = new wchar_t[source.count() + 1];
-  source.toWCharArray(buffer);
-  buffer[source.count()] = L'\0';
-  std::wstring result(buffer);
-  delete [] buffer;
+  return transferFilesRecursive(files, baseDir, TransferMode::Move, DeployMode::Copy);
+}
+
+bool copyFilesRecursive(const QList<QPair<QString, QString>> &files, const QString &baseDir, DeployMode mode)
+{
+  return transferFilesRecursive(files, baseDir, TransferMode::Copy, mode);
+}
 
+
+std::wstring ToWString(const QString &source)
+{
+  std::wstring result;
+  ToWString(source, result);
   return result;
 }
 
+void ToWString(const QString &source, std::wstring &target)
+{
+  // wchar_t is utf-16 on windows, this is a plain copy that keeps embedded 0s
+  target.resize(source.size());
+  target.resize(source.toWCharArray(&target[0]));
+}
+
 std::string ToString(const QString &source, bool utf8)
 {
-  QByteArray array8bit;
+  std::string result;
+  ToString(source, result, utf8);
+  return result;
+}
+
+void ToString(const QString &source, std::string &target, bool utf8)
+{
   if (utf8) {
-    array8bit = source.toUtf8();
+    // transcode straight into the target instead of going through a QByteArray
+    target.resize(static_cast<size_t>(source.size()) * 3);
+    target.resize(utf16ToUtf8(source.utf16(), source.size(), &target[0]));
   } else {
-    array8bit = source.toLocal8Bit();
+    QByteArray array8bit = source.toLocal8Bit();
+    target.assign(array8bit.constData(), array8bit.size());
   }
-  return std::string(array8bit.constData());
 }
 
 QString ToQString(const std::string &source)
 {
-  return QString::fromUtf8(source.c_str());
+  return QString::fromUtf8(source.data(), static_cast<int>(source.size()));
 }
 
 QString ToQString(const std::wstring &source)
 {
-#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
-  return QString::fromWCharArray(source.c_str());
-#else
-  return QString::fromUtf16(source.c_str());
-#endif
+  return QString::fromWCharArray(source.data(), static_cast<int>(source.size()));
+}
+
+QString ToQString(const char *source, int length)
+{
+  return QString::fromUtf8(source, length);
+}
+
+QString ToQString(const wchar_t *source, int length)
+{
+  return QString::fromWCharArray(source, length);
+}
+
+void ToQString(const char *source, int length, QString &target)
+{
+  // utf-16 never needs more code units than utf-8 needs bytes
+  target.resize(length);
+  target.resize(utf8ToUtf16(source, length, reinterpret_cast<ushort*>(target.data())));
 }
 
 QString ToString(const SYSTEMTIME &time)
@@ -367,7 +413,12 @@ bool fixDirectoryName(QString &name)
   QString temp = name.simplified();
   while (temp.endsWith('.')) temp.chop(1);
 
-  temp.replace(QRegExp("[<>:\"/\\|?*]"), "");
+  static const QString invalidCharacters("<>:\"/|?*");
+  for (int i = temp.size() - 1; i >= 0; --i) {
+    if (invalidCharacters.contains(temp.at(i))) {
+      temp.remove(i, 1);
+    }
+  }
   static QString invalidNames[] = { "CON", "PRN", "AUX", "NUL", "COM1", "COM2", "COM3", "COM4", "COM5", "COM6", "COM7", "COM8", "COM9",
                                     "LPT1", "LPT2", "LPT3", "LPT4", "LPT5", "LPT6", "LPT7", "LPT8", "LPT9" };
   for (unsigned int i = 0; i < sizeof(invalidNames) / sizeof(QString); ++i) {
@@ -432,16 +483,46 @@ QString readFileText(const QString &fileName, QString *encoding)
     return QString();
   }
 
-  QByteArray buffer = textFile.readAll();
-  QTextCodec *codec = QTextCodec::codecForUtfText(buffer, utf8Codec);
-  QString text = codec->toUnicode(buffer);
+  // map the file so the data isn't copied before decoding. Some files (i.e. on
+  // network drives) can't be mapped, those are read the regular way
+  QByteArray buffer;
+  const char *data = nullptr;
+  qint64 size = textFile.size();
+  uchar *mapped = size > 0 ? textFile.map(0, size) : nullptr;
+  if (mapped != nullptr) {
+    data = reinterpret_cast<const char*>(mapped);
+  } else {
+    buffer = textFile.readAll();
+    data = buffer.constData();
+    size = buffer.size();
+  }
 
-  // check reverse conversion. If this was unicode text there can't be data loss
-  // this assumes QString doesn't normalize the data in any way so this is a bit unsafe
-  if (codec->fromUnicode(text) != buffer) {
-    qDebug("conversion failed assuming local encoding");
-    codec = QTextCodec::codecForLocale();
-    text = codec->toUnicode(buffer);
+  QTextCodec *codec = utf8Codec;
+  QString text;
+
+  static const char utf8Bom[] = "\xEF\xBB\xBF";
+  bool hasUtf8Bom = (size >= 3) && (memcmp(data, utf8Bom, 3) == 0);
+  const char *utf8Data = hasUtf8Bom ? data + 3 : data;
+  qint64 utf8Size = hasUtf8Bom ? size - 3 : size;
+
+  if (isValidUtf8(utf8Data, utf8Size)) {
+    // utf-8 (or ascii) is by far the most common case and the only one that gets
+    // validated, so it's checked first
+    text = QString::fromUtf8(utf8Data, static_cast<int>(utf8Size));
+  } else {
+    // utf-16 and utf-32 can only be recognized by their bom, otherwise
+    // assume local encoding
+    codec = QTextCodec::codecForUtfText(QByteArray::fromRawData(data, static_cast<int>(std::min<qint64>(size, 4))),
+                                        nullptr);
+    if ((codec == nullptr) || (codec->mibEnum() == utf8Codec->mibEnum())) {
+      qDebug("file is not valid utf-8, assuming local encoding");
+      codec = QTextCodec::codecForLocale();
+    }
+    text = codec->toUnicode(data, static_cast<int>(size));
+  }
+
+  if (mapped != nullptr) {
+    textFile.unmap(mapped);
   }
 
   if (encoding != nullptr) {
@@ -451,9 +532,151 @@ QString readFileText(const QString &fileName, QString *encoding)
   return text;
 }
 
+
+TextFileReader::TextFileReader(const QString &fileName, int chunkSize)
+  : m_File(fileName)
+  , m_ChunkSize(std::max(chunkSize, 16))
+  , m_Codec(nullptr)
+  , m_PendingPos(0)
+{
+  if (m_File.open(QIODevice::ReadOnly)) {
+    m_Codec = detectEncoding();
+    m_Decoder.reset(m_Codec->makeDecoder());
+  }
+}
+
+TextFileReader::~TextFileReader()
+{
+}
+
+QTextCodec *TextFileReader::detectEncoding()
+{
+  static QTextCodec *utf8Codec = QTextCodec::codecForName("utf-8");
+
+  m_Head = m_File.read(m_ChunkSize);
+
+  QTextCodec *bomCodec = QTextCodec::codecForUtfText(m_Head, nullptr);
+  if ((bomCodec != nullptr) && (bomCodec->mibEnum() != utf8Codec->mibEnum())) {
+    return bomCodec;
+  }
+
+  bool valid = false;
+  qint64 size = m_File.size();
+  uchar *mapped = size > 0 ? m_File.map(0, size) : nullptr;
+  if (mapped != nullptr) {
+    // check the whole file so the result is the same as with readFileText. The
+    // mapping doesn't count against our memory limit
+    valid = isValidUtf8(reinterpret_cast<const char*>(mapped), size);
+    m_File.unmap(mapped);
+  } else {
+    // can only judge by the first chunk. Up to three bytes at its end may belong
+    // to a character that continues in the next chunk
+    qint64 validLength = validUtf8Length(m_Head.constData(), m_Head.size());
+    valid = (validLength == m_Head.size())
+         || (!m_File.atEnd() && (m_Head.size() - validLength < 4));
+  }
+
+  if (valid) {
+    return utf8Codec;
+  } else {
+    qDebug("file is not valid utf-8, assuming local encoding");
+    return QTextCodec::codecForLocale();
+  }
+}
+
+bool TextFileReader::isOpen() const
+{
+  return m_Decoder.get() != nullptr;
+}
+
+QString TextFileReader::encoding() const
+{
+  return m_Codec != nullptr ? QString(m_Codec->name()) : QString();
+}
+
+bool TextFileReader::atEnd() const
+{
+  return !isOpen()
+      || ((m_PendingPos >= m_Pending.size()) && m_Head.isEmpty() && m_File.atEnd());
+}
+
+bool TextFileReader::decodeNext(QString &text)
+{
+  if (!isOpen()) {
+    return false;
+  }
+
+  QByteArray raw;
+  if (!m_Head.isEmpty()) {
+    raw.swap(m_Head);
+  } else {
+    raw = m_File.read(m_ChunkSize);
+  }
+  if (raw.isEmpty()) {
+    return false;
+  }
+  text = m_Decoder->toUnicode(raw);
+  return true;
+}
+
+bool TextFileReader::readChunk(QString &text)
+{
+  if (m_PendingPos < m_Pending.size()) {
+    text = m_Pending.mid(m_PendingPos);
+    m_Pending.clear();
+    m_PendingPos = 0;
+    return true;
+  }
+  return decodeNext(text);
+}
+
+bool TextFileReader::readLine(QString &line)
+{
+  int searchPos = m_PendingPos;
+  for (;;) {
+    int lineEnd = m_Pending.indexOf('\n', searchPos);
+    if (lineEnd != -1) {
+      int length = lineEnd - m_PendingPos;
+      if ((length > 0) && (m_Pending.at(lineEnd - 1) == '\r')) {
+        --length;
+      }
+      line = m_Pending.mid(m_PendingPos, length);
+      m_PendingPos = lineEnd + 1;
+      return true;
+    }
+
+    QString chunk;
+    if (!decodeNext(chunk)) {
+      // last line without a line break
+      if (m_PendingPos < m_Pending.size()) {
+        line = m_Pending.mid(m_PendingPos);
+        if (line.endsWith('\r')) {
+          line.chop(1);
+        }
+        m_Pending.clear();
+        m_PendingPos = 0;
+        return true;
+      }
+      return false;
+    }
+
+    // drop the lines already returned so the buffer doesn't grow with the file
+    m_Pending = m_Pending.mid(m_PendingPos) + chunk;
+    m_PendingPos = 0;
+    // don't scan long lines again for every chunk
+    searchPos = m_Pending.size() - chunk.size();
+  }
+}
+
 void removeOldFiles(const QString &path, const QString &pattern, int numToKeep, QDir::SortFlags sorting)
 {
-  QFileInfoList files = QDir(path).entryInfoList(QStringList(pattern), QDir::Files, sorting);
+  GlobPattern filePattern(pattern);
+  QFileInfoList files;
+  foreach (const QFileInfo &file, QDir(path).entryInfoList(QDir::Files, sorting)) {
+    if (filePattern.matches(file.fileName())) {
+      files.append(file);
+    }
+  }
 
   if (files.count() > numToKeep) {
     QStringList deleteFiles;
@@ -470,12 +693,9 @@ void removeOldFiles(const QString &path, const QString &pattern, int numToKeep,
 
 QIcon iconForExecutable(const QString &filePath)
 {
-  HICON winIcon;
-  UINT res = ::ExtractIconExW(ToWString(filePath).c_str(), 0, &winIcon, nullptr, 1);
-  if (res == 1) {
-    QIcon result = QIcon(QtWin::fromHICON(winIcon));
-    ::DestroyIcon(winIcon);
-    return result;
+  QImage image = IconCache::instance().image(filePath);
+  if (!image.isNull()) {
+    return QIcon(QPixmap::fromImage(image));
   } else {
     return QIcon(":/MO/gui/executable");
   }
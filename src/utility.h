@@ -22,10 +22,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #define UTILITY_H
 
 #include "dllimport.h"
+#include "filecopy.h"
 #include <vector>
 #include <set>
 #include <algorithm>
+#include <memory>
 #include <QString>
+#include <QFile>
+#include <QPair>
 #include <QTextStream>
 #include <QDir>
 #include <QIcon>
@@ -38,6 +42,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <Windows.h>
 
 
+class QTextCodec;
+class QTextDecoder;
+
+
 namespace MOBase {
 
 QDLLEXPORT QString windowsErrorString(DWORD errorCode);
@@ -47,6 +55,8 @@ QDLLEXPORT QString windowsErrorString(DWORD errorCode);
  *
  * @param dirName name of the directory to delete
  * @return true on success. in case of an error, "removeDir" itself displays an error message
+ * @note independent sub-directories are removed on multiple threads and removal continues
+ *       past errors. Use removeDirParallel (fileremove.h) to get the list of failures
  **/
 QDLLEXPORT bool removeDir(const QString &dirName);
 
@@ -56,10 +66,15 @@ QDLLEXPORT bool removeDir(const QString &dirName);
  * @param destinationName name of the target directory
  * @param merge if true, the destination directory is allowed to exist, files will then
  *              be added to that directory. If false, the call will fail in that case
+ * @param mode if DeployMode::Link, files are hard linked where source and destination
+ *             share a volume and copied otherwise
  * @return true if files were copied. This doesn't necessary mean ALL files were copied
  * @note symbolic links are not followed to prevent endless recursion
+ * @note files are copied on multiple threads. Use copyDirParallel (filecopy.h) to get a report
+ *       of the files that failed to copy and how each file was deployed
  */
-QDLLEXPORT bool copyDir(const QString &sourceName, const QString &destinationName, bool merge);
+QDLLEXPORT bool copyDir(const QString &sourceName, const QString &destinationName, bool merge,
+                        DeployMode mode = DeployMode::Copy);
 
 /**
  * @brief move a file, creating subdirectories as needed
@@ -73,9 +88,32 @@ QDLLEXPORT bool moveFileRecursive(const QString &source, const QString &baseDir,
  * @brief copy a file, creating subdirectories as needed
  * @param source source file name
  * @param destination destination file name
+ * @param mode if DeployMode::Link, the file is hard linked if possible and copied otherwise
+ * @param method (optional) receives how the file was deployed
  * @return true if the file was successfully copied
  */
-QDLLEXPORT bool copyFileRecursive(const QString &source, const QString &baseDir, const QString &destination);
+QDLLEXPORT bool copyFileRecursive(const QString &source, const QString &baseDir, const QString &destination,
+                                  DeployMode mode = DeployMode::Copy, DeployMethod *method = nullptr);
+
+/**
+ * @brief move a list of files, creating subdirectories as needed
+ * @param files pairs of source file name and destination file name relative to baseDir
+ * @param baseDir the directory destinations are relative to
+ * @return true if all files were moved. in case of an error, an error message is displayed
+ * @note considerably faster than calling moveFileRecursive for each file
+ */
+QDLLEXPORT bool moveFilesRecursive(const QList<QPair<QString, QString>> &files, const QString &baseDir);
+
+/**
+ * @brief copy a list of files, creating subdirectories as needed
+ * @param files pairs of source file name and destination file name relative to baseDir
+ * @param baseDir the directory destinations are relative to
+ * @param mode if DeployMode::Link, files are hard linked if possible and copied otherwise
+ * @return true if all files were copied. in case of an error, an error message is displayed
+ * @note considerably faster than calling copyFileRecursive for each file
+ */
+QDLLEXPORT bool copyFilesRecursive(const QList<QPair<QString, QString>> &files, const QString &baseDir,
+                                   DeployMode mode = DeployMode::Copy);
 
 /**
  * @brief copy one or multiple files using a shell operation (this will ask the user for confirmation on overwrite
@@ -270,6 +308,11 @@ QList<T> ConvertList(const QVariantList &variants)
  **/
 QDLLEXPORT std::wstring ToWString(const QString &source);
 
+/**
+ * @brief convert QString to std::wstring (utf-16 encoding), reusing the memory of target
+ **/
+QDLLEXPORT void ToWString(const QString &source, std::wstring &target);
+
 /**
  * @brief convert QString to std::string
  * @param source source string
@@ -277,6 +320,14 @@ QDLLEXPORT std::wstring ToWString(const QString &source);
  **/
 QDLLEXPORT std::string ToString(const QString &source, bool utf8 = true);
 
+/**
+ * @brief convert QString to std::string, reusing the memory of target
+ * @param source source string
+ * @param target receives the converted string
+ * @param utf8 if true, the output string is utf8, otherwise it's the local 8bit encoding (according to qt)
+ **/
+QDLLEXPORT void ToString(const QString &source, std::string &target, bool utf8 = true);
+
 /**
  * @brief convert std::string to QString (assuming the string to be utf-8 encoded)
  **/
@@ -287,6 +338,28 @@ QDLLEXPORT QString ToQString(const std::string &source);
  **/
 QDLLEXPORT QString ToQString(const std::wstring &source);
 
+/**
+ * @brief convert a utf-8 encoded character sequence to QString
+ * @param source the characters, don't need to be 0-terminated
+ * @param length number of bytes in source
+ **/
+QDLLEXPORT QString ToQString(const char *source, int length);
+
+/**
+ * @brief convert a utf-16 encoded character sequence to QString
+ * @param source the characters, don't need to be 0-terminated
+ * @param length number of characters in source
+ **/
+QDLLEXPORT QString ToQString(const wchar_t *source, int length);
+
+/**
+ * @brief convert a utf-8 encoded character sequence to QString, reusing the memory of target
+ * @param source the characters, don't need to be 0-terminated
+ * @param length number of bytes in source
+ * @param target receives the converted string
+ **/
+QDLLEXPORT void ToQString(const char *source, int length, QString &target);
+
 /**
  * @brief convert a systemtime object to a string containing date and time in local representation
  *
@@ -317,9 +390,93 @@ QDLLEXPORT bool fixDirectoryName(QString &name);
  * @param fileName name of the file to read
  * @param encoding (optional) if this is set, the target variable received the name of the encoding used
  * @return the textual content of the file or an empty string if the file doesn't exist
+ * @note files that are valid utf-8 (with or without bom) are read as utf-8, files with a utf-16
+ *       or utf-32 bom accordingly. Everything else is decoded with the local 8-bit encoding
  **/
 QDLLEXPORT QString readFileText(const QString &fileName, QString *encoding = nullptr);
 
+/**
+ * @brief reads a text file incrementally with bounded memory use. Intended for files
+ *        too large to be read with readFileText
+ *
+ * The encoding is determined when the file is opened, using the same rules as
+ * readFileText. The file is then decoded in chunks of fixed size, characters split
+ * across chunk boundaries are handled by the decoder
+ * @code
+ * TextFileReader reader(fileName);
+ * QString line;
+ * while (reader.readLine(line)) {
+ *   ...
+ * }
+ * @endcode
+ */
+class QDLLEXPORT TextFileReader
+{
+public:
+
+  static const int DefaultChunkSize = 64 * 1024;
+
+public:
+
+  /**
+   * @brief open the file and detect its encoding
+   * @param fileName name of the file to read
+   * @param chunkSize number of bytes to decode at a time
+   */
+  explicit TextFileReader(const QString &fileName, int chunkSize = DefaultChunkSize);
+
+  ~TextFileReader();
+
+  /**
+   * @return true if the file could be opened
+   */
+  bool isOpen() const;
+
+  /**
+   * @return name of the encoding that was detected
+   */
+  QString encoding() const;
+
+  /**
+   * @return true if all text has been read
+   */
+  bool atEnd() const;
+
+  /**
+   * @brief read the next piece of text. Pieces are decoded from chunkSize bytes of the file
+   * @param text receives the text
+   * @return false if the end of the file has been reached or the read failed
+   */
+  bool readChunk(QString &text);
+
+  /**
+   * @brief read the next line
+   * @param line receives the line without the line break
+   * @return false if the end of the file has been reached or the read failed
+   * @note memory use is bounded by the chunk size plus the length of the longest line
+   */
+  bool readLine(QString &line);
+
+private:
+
+  QTextCodec *detectEncoding();
+  bool decodeNext(QString &text);
+
+private:
+
+  Q_DISABLE_COPY(TextFileReader)
+
+  QFile m_File;
+  int m_ChunkSize;
+  QTextCodec *m_Codec;
+  std::unique_ptr<QTextDecoder> m_Decoder;
+  // raw data read during encoding detection that hasn't been decoded yet
+  QByteArray m_Head;
+  QString m_Pending;
+  int m_PendingPos;
+
+};
+
 /**
  * @brief delete files matching a pattern
  * @param directory in which to delete files
@@ -333,6 +490,7 @@ QDLLEXPORT void removeOldFiles(const QString &path, const QString &pattern, int
  * @brief retrieve the icon of an executable. Currently this always extracts the biggest icon
  * @param absolute path to the executable
  * @return the icon
+ * @note icons are cached in memory and on disk, see IconCache (iconcache.h)
  **/
 QDLLEXPORT QIcon iconForExecutable(const QString &filePath);
 